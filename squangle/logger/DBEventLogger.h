@@ -41,6 +41,7 @@ enum class OperationType {
   Reset,
   ChangeUser,
   ThriftQuery,
+  PreparedQuery,
 };
 
 class EnumHelper {
@@ -86,6 +87,8 @@ class EnumHelper {
         return "ChangeUser";
       case OperationType::ThriftQuery:
         return "ThriftQuery";
+      case OperationType::PreparedQuery:
+        return "PreparedQuery";
     }
     return "(should not happen)";
   }
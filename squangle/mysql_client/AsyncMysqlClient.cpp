@@ -282,10 +282,41 @@ MysqlHandler::Status AsyncMysqlClient::AsyncMysqlHandler::fetchRow(
   return status;
 }
 
+size_t AsyncMysqlClient::AsyncMysqlHandler::fetchRows(
+    MYSQL_RES* res,
+    folly::Range<MYSQL_ROW*> rows,
+    unsigned long* lengths,
+    bool& finished) {
+  return fetchReadyRows(*this, res, rows, lengths, finished);
+}
+
 MYSQL_RES* AsyncMysqlClient::AsyncMysqlHandler::getResult(MYSQL* mysql) {
   return mysql_use_result(mysql);
 }
 
+MysqlHandler::Status AsyncMysqlClient::AsyncMysqlHandler::prepareStatement(
+    MYSQL_STMT* stmt,
+    folly::StringPiece statement) {
+  return toHandlerStatus(mysql_stmt_prepare_nonblocking(
+      stmt, statement.begin(), statement.size()));
+}
+
+MysqlHandler::Status AsyncMysqlClient::AsyncMysqlHandler::executeStatement(
+    MYSQL_STMT* stmt) {
+  return toHandlerStatus(mysql_stmt_execute_nonblocking(stmt));
+}
+
+MysqlHandler::Status AsyncMysqlClient::AsyncMysqlHandler::fetchStatementRow(
+    MYSQL_STMT* stmt,
+    int& fetch_result) {
+  auto status =
+      toHandlerStatus(mysql_stmt_fetch_nonblocking(stmt, &fetch_result));
+  if (status == DONE && fetch_result == 1) {
+    return ERROR;
+  }
+  return status;
+}
+
 AsyncConnection::~AsyncConnection() {
   if (mysql_connection_ && conn_dying_callback_ && needToCloneConnection_ &&
       isReusable() && !inTransaction() &&
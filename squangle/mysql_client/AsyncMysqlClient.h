@@ -273,7 +273,7 @@ class AsyncMysqlClient : public MysqlClientBase {
   }
 
   // implementation of MysqlHandler interface
-  class AsyncMysqlHandler : public MysqlHandler {
+  class AsyncMysqlHandler final : public MysqlHandler {
     Status tryConnect(
         MYSQL* mysql,
         const ConnectionOptions& /*opts*/,
@@ -283,6 +283,14 @@ class AsyncMysqlClient : public MysqlClientBase {
     Status runQuery(MYSQL* mysql, folly::StringPiece queryStmt) override;
     Status nextResult(MYSQL* mysql) override;
     Status fetchRow(MYSQL_RES* res, MYSQL_ROW& row) override;
+    size_t fetchRows(
+        MYSQL_RES* res,
+        folly::Range<MYSQL_ROW*> rows,
+        unsigned long* lengths,
+        bool& finished) override;
+    bool buffersResults() const override {
+      return false;
+    }
     Status resetConn(MYSQL* mysql) override;
     Status changeUser(
         MYSQL* mysql,
@@ -290,6 +298,10 @@ class AsyncMysqlClient : public MysqlClientBase {
         const std::string& password,
         const std::string& database) override;
     MYSQL_RES* getResult(MYSQL* mysql) override;
+    Status prepareStatement(MYSQL_STMT* stmt, folly::StringPiece statement)
+        override;
+    Status executeStatement(MYSQL_STMT* stmt) override;
+    Status fetchStatementRow(MYSQL_STMT* stmt, int& fetch_result) override;
   } mysql_handler_;
 
   // Private methods, primarily used by Operations and its subclasses.
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+// Tests on the 8 bytes of a word at once, for the escaping loops of
+// EscapeString.cpp and JsonWriter.cpp.  Internal to mysql_client.
+
+namespace facebook::common::mysql_client::detail {
+
+constexpr uint64_t kOnes = 0x0101010101010101ULL;
+constexpr uint64_t kHighBits = 0x8080808080808080ULL;
+
+// Non-zero if any byte of `word` is `c`.
+inline uint64_t hasByte(uint64_t word, uint8_t c) {
+  uint64_t x = word ^ (kOnes * c);
+  return (x - kOnes) & ~x & kHighBits;
+}
+
+// Non-zero if any byte of `word` is below `n`, for n <= 128.
+inline uint64_t hasByteBelow(uint64_t word, uint8_t n) {
+  return (word - kOnes * n) & ~word & kHighBits;
+}
+
+} // namespace facebook::common::mysql_client::detail
@@ -0,0 +1,324 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/Format.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+
+#include "squangle/mysql_client/ColumnarExport.h"
+
+namespace facebook::common::mysql_client {
+
+namespace {
+
+// Points the values of empty string columns somewhere valid.
+const uint64_t kEmptyBuffer = 0;
+
+// Buffers are allocated in zeroed 8 byte words, the alignment Arrow asks
+// for at least.
+template <typename T>
+T* allocate(ColumnarBatch& batch, size_t count) {
+  auto words = std::max<size_t>((count * sizeof(T) + 7) / 8, 1);
+  batch.storage.push_back(std::make_unique<uint64_t[]>(words));
+  return reinterpret_cast<T*>(batch.storage.back().get());
+}
+
+// Adds the validity bitmap from a mask with a bit set per NULL.
+void addValidity(
+    ColumnarBatch& batch,
+    ColumnarColumn& column,
+    const std::vector<uint64_t>& null_mask) {
+  if (column.null_count == 0) {
+    column.buffers.push_back(nullptr);
+    return;
+  }
+  auto* validity = allocate<uint64_t>(batch, null_mask.size());
+  for (size_t i = 0; i < null_mask.size(); ++i) {
+    validity[i] = ~null_mask[i];
+  }
+  column.buffers.push_back(validity);
+}
+
+template <typename T>
+void addNumericColumn(
+    ColumnarBatch& batch,
+    ColumnarColumn& column,
+    const RowBlock& block,
+    size_t field_num,
+    const char* format) {
+  column.format = format;
+  auto num_rows = block.numRows();
+  auto* values = allocate<T>(batch, num_rows);
+  std::vector<uint64_t> null_mask((num_rows + 63) / 64);
+  auto status = block.decodeColumn<T>(
+      field_num, folly::Range<T*>(values, num_rows), folly::range(null_mask));
+  if (!status.ok()) {
+    throw std::range_error(folly::sformat(
+        "Field {} has a value that can't be converted at row {}",
+        column.name,
+        *status.first_error_row));
+  }
+  column.null_count = status.num_nulls;
+  addValidity(batch, column, null_mask);
+  column.buffers.push_back(values);
+}
+
+// Adds num_rows + 1 offsets, the first one 0 and the others the ends of
+// the values.
+template <typename Offset, typename EndOf>
+void addOffsets(
+    ColumnarBatch& batch,
+    ColumnarColumn& column,
+    size_t num_rows,
+    const EndOf& end_of) {
+  auto* offsets = allocate<Offset>(batch, num_rows + 1);
+  offsets[0] = 0;
+  for (size_t row = 0; row < num_rows; ++row) {
+    offsets[row + 1] = static_cast<Offset>(end_of(row));
+  }
+  column.buffers.push_back(offsets);
+}
+
+void addStringColumn(
+    ColumnarBatch& batch,
+    ColumnarColumn& column,
+    const RowBlock& block,
+    size_t field_num,
+    bool binary) {
+  auto num_rows = block.numRows();
+  std::vector<uint64_t> null_mask((num_rows + 63) / 64);
+  for (size_t row = 0; row < num_rows; ++row) {
+    if (block.isNull(row, field_num)) {
+      null_mask[row / 64] |= uint64_t(1) << (row % 64);
+      ++column.null_count;
+    }
+  }
+  addValidity(batch, column, null_mask);
+
+  // Values of the Columns and Mapped layouts are used in place, others are
+  // copied into a buffer of their own.
+  std::optional<RowBlock::ColumnBuffer> buffer;
+  if (block.getFieldStorage(field_num) == FieldStorage::Text) {
+    buffer = block.columnBuffer(field_num);
+  }
+  std::string copied;
+  std::vector<size_t> copied_ends;
+  if (!buffer) {
+    copied_ends.reserve(num_rows);
+    for (size_t row = 0; row < num_rows; ++row) {
+      if (!block.isNull(row, field_num)) {
+        if (block.getFieldStorage(field_num) == FieldStorage::Text) {
+          auto value = block.getField<folly::StringPiece>(row, field_num);
+          copied.append(value.data(), value.size());
+        } else {
+          copied += block.getField<std::string>(row, field_num);
+        }
+      }
+      copied_ends.push_back(copied.size());
+    }
+  }
+  auto values_size = buffer ? buffer->values.size() : copied.size();
+  auto end_of = [&](size_t row) -> size_t {
+    return buffer ? buffer->ends[row] : copied_ends[row];
+  };
+
+  bool large = values_size >
+      static_cast<size_t>(std::numeric_limits<int32_t>::max());
+  if (large) {
+    column.format = binary ? "Z" : "U";
+    addOffsets<int64_t>(batch, column, num_rows, end_of);
+  } else {
+    column.format = binary ? "z" : "u";
+    addOffsets<int32_t>(batch, column, num_rows, end_of);
+  }
+
+  if (values_size == 0) {
+    column.buffers.push_back(&kEmptyBuffer);
+  } else if (buffer) {
+    column.buffers.push_back(buffer->values.data());
+  } else {
+    auto* values = allocate<char>(batch, copied.size());
+    std::memcpy(values, copied.data(), copied.size());
+    column.buffers.push_back(values);
+  }
+}
+
+void addColumn(ColumnarBatch& batch, const RowBlock& block, size_t field_num) {
+  auto& column = batch.columns.emplace_back();
+  column.name = block.fieldName(field_num).str();
+  column.length = block.numRows();
+  auto flags = block.getFieldFlags(field_num);
+  bool is_unsigned = flags & UNSIGNED_FLAG;
+  switch (block.getFieldType(field_num)) {
+    case MYSQL_TYPE_TINY:
+      return is_unsigned
+          ? addNumericColumn<uint8_t>(batch, column, block, field_num, "C")
+          : addNumericColumn<int8_t>(batch, column, block, field_num, "c");
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_YEAR:
+      return is_unsigned
+          ? addNumericColumn<uint16_t>(batch, column, block, field_num, "S")
+          : addNumericColumn<int16_t>(batch, column, block, field_num, "s");
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+      return is_unsigned
+          ? addNumericColumn<uint32_t>(batch, column, block, field_num, "I")
+          : addNumericColumn<int32_t>(batch, column, block, field_num, "i");
+    case MYSQL_TYPE_LONGLONG:
+      return is_unsigned
+          ? addNumericColumn<uint64_t>(batch, column, block, field_num, "L")
+          : addNumericColumn<int64_t>(batch, column, block, field_num, "l");
+    case MYSQL_TYPE_FLOAT:
+      return addNumericColumn<float>(batch, column, block, field_num, "f");
+    case MYSQL_TYPE_DOUBLE:
+      return addNumericColumn<double>(batch, column, block, field_num, "g");
+    case MYSQL_TYPE_NULL:
+      // The null type has no buffers.
+      column.format = "n";
+      column.null_count = column.length;
+      return;
+    case MYSQL_TYPE_BIT:
+    case MYSQL_TYPE_GEOMETRY:
+      return addStringColumn(batch, column, block, field_num, true);
+    default:
+      return addStringColumn(
+          batch, column, block, field_num, flags & BINARY_FLAG);
+  }
+}
+
+// What the exported arrays and schemas own.  Child arrays and schemas hold
+// a reference of their own so they can be moved out of their parent.
+struct ExportedArray {
+  std::shared_ptr<ColumnarBatch> batch;
+  std::vector<ArrowArray> children;
+  std::vector<ArrowArray*> child_pointers;
+  const void* validity = nullptr;
+};
+
+struct SchemaStrings {
+  std::vector<std::string> names;
+  std::vector<std::string> formats;
+};
+
+struct ExportedSchema {
+  std::shared_ptr<SchemaStrings> strings;
+  std::vector<ArrowSchema> children;
+  std::vector<ArrowSchema*> child_pointers;
+};
+
+void releaseChildArray(ArrowArray* array) {
+  delete static_cast<std::shared_ptr<ColumnarBatch>*>(array->private_data);
+  array->release = nullptr;
+}
+
+void releaseArray(ArrowArray* array) {
+  auto* exported = static_cast<ExportedArray*>(array->private_data);
+  for (auto& child : exported->children) {
+    if (child.release) {
+      child.release(&child);
+    }
+  }
+  delete exported;
+  array->release = nullptr;
+}
+
+void releaseChildSchema(ArrowSchema* schema) {
+  delete static_cast<std::shared_ptr<SchemaStrings>*>(schema->private_data);
+  schema->release = nullptr;
+}
+
+void releaseSchema(ArrowSchema* schema) {
+  auto* exported = static_cast<ExportedSchema*>(schema->private_data);
+  for (auto& child : exported->children) {
+    if (child.release) {
+      child.release(&child);
+    }
+  }
+  delete exported;
+  schema->release = nullptr;
+}
+
+} // namespace
+
+ColumnarBatch toColumnarBatch(
+    const RowBlock& block,
+    std::shared_ptr<const void> owner) {
+  ColumnarBatch batch;
+  batch.length = block.numRows();
+  batch.owner = std::move(owner);
+  batch.columns.reserve(block.numFields());
+  for (size_t field_num = 0; field_num < block.numFields(); ++field_num) {
+    addColumn(batch, block, field_num);
+  }
+  return batch;
+}
+
+void exportColumnarBatch(
+    ColumnarBatch&& batch,
+    ArrowSchema* schema,
+    ArrowArray* array) {
+  auto shared_batch = std::make_shared<ColumnarBatch>(std::move(batch));
+  auto num_columns = shared_batch->columns.size();
+
+  auto strings = std::make_shared<SchemaStrings>();
+  for (const auto& column : shared_batch->columns) {
+    strings->names.push_back(column.name);
+    strings->formats.push_back(column.format);
+  }
+  auto exported_schema = std::make_unique<ExportedSchema>();
+  exported_schema->strings = strings;
+  exported_schema->children.resize(num_columns);
+  for (size_t i = 0; i < num_columns; ++i) {
+    auto& child = exported_schema->children[i];
+    child = ArrowSchema{};
+    child.format = strings->formats[i].c_str();
+    child.name = strings->names[i].c_str();
+    child.flags = ARROW_FLAG_NULLABLE;
+    child.release = releaseChildSchema;
+    child.private_data = new std::shared_ptr<SchemaStrings>(strings);
+    exported_schema->child_pointers.push_back(&child);
+  }
+
+  auto exported_array = std::make_unique<ExportedArray>();
+  exported_array->batch = shared_batch;
+  exported_array->children.resize(num_columns);
+  for (size_t i = 0; i < num_columns; ++i) {
+    auto& column = shared_batch->columns[i];
+    auto& child = exported_array->children[i];
+    child = ArrowArray{};
+    child.length = column.length;
+    child.null_count = column.null_count;
+    child.n_buffers = column.buffers.size();
+    child.buffers = column.buffers.data();
+    child.release = releaseChildArray;
+    child.private_data = new std::shared_ptr<ColumnarBatch>(shared_batch);
+    exported_array->child_pointers.push_back(&child);
+  }
+
+  *schema = ArrowSchema{};
+  schema->format = "+s";
+  schema->name = "";
+  schema->n_children = num_columns;
+  schema->children = exported_schema->child_pointers.data();
+  schema->release = releaseSchema;
+  schema->private_data = exported_schema.release();
+
+  *array = ArrowArray{};
+  array->length = shared_batch->length;
+  array->n_buffers = 1;
+  array->buffers = &exported_array->validity;
+  array->n_children = num_columns;
+  array->children = exported_array->child_pointers.data();
+  array->release = releaseArray;
+  array->private_data = exported_array.release();
+}
+
+} // namespace facebook::common::mysql_client
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "squangle/mysql_client/Row.h"
+
+// The Arrow C Data Interface, copied from the Arrow specification as it
+// asks for, so results can be handed to Arrow based engines without linking
+// Arrow.
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  // Array type description
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowSchema*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+struct ArrowArray {
+  // Array data description
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowArray*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+#endif // ARROW_C_DATA_INTERFACE
+
+namespace facebook::common::mysql_client {
+
+// A column of a ColumnarBatch in the Arrow columnar format.  Its type is
+// picked from the field's enum_field_types and flags:
+//
+//   TINY, SHORT, INT24, LONG, LONGLONG, YEAR  signed or unsigned integers
+//                                             of the column's width
+//   FLOAT, DOUBLE                             float and double
+//   NULL                                      null
+//   everything else                           utf8, or binary for BINARY
+//                                             and BIT fields, as the text
+//                                             protocol returns them
+//
+// DECIMAL and temporal columns stay strings rather than being parsed.
+struct ColumnarColumn {
+  std::string name;
+  // Arrow format string, e.g. "l" for int64 or "u" for utf8.  Strings
+  // whose values don't fit int32 offsets use the large variants.
+  std::string format;
+  int64_t length = 0;
+  int64_t null_count = 0;
+  // As in ArrowArray::buffers: the validity bitmap, nullptr without NULLs,
+  // then the values for fixed width types or the offsets and the values
+  // for strings.
+  std::vector<const void*> buffers;
+};
+
+// The rows of a RowBlock as a record batch.  String values of blocks with
+// the Columns or Mapped layout aren't copied, the batch points into the
+// block's buffer; every other buffer is built for the batch.
+struct ColumnarBatch {
+  int64_t length = 0;
+  std::vector<ColumnarColumn> columns;
+  // Buffers built for the batch.
+  std::vector<std::unique_ptr<uint64_t[]>> storage;
+  // Keeps borrowed buffers alive, if set; otherwise the block must outlive
+  // the batch.
+  std::shared_ptr<const void> owner;
+};
+
+// Converts `block`, see QueryResult::toColumnar.  Throws std::range_error
+// if a numeric column has a value that can't be converted.
+ColumnarBatch toColumnarBatch(
+    const RowBlock& block,
+    std::shared_ptr<const void> owner = nullptr);
+
+// Moves `batch` into an Arrow struct array with a child per column, and
+// describes it in `schema`.  Both have to be released by the consumer as
+// the C Data Interface says; child arrays and schemas may be moved out and
+// released on their own.
+void exportColumnarBatch(
+    ColumnarBatch&& batch,
+    ArrowSchema* schema,
+    ArrowArray* array);
+
+} // namespace facebook::common::mysql_client
@@ -146,6 +146,15 @@ std::shared_ptr<MultiQueryStreamOperation> Connection::beginMultiQueryStreaming(
   return operation;
 }
 
+template <>
+std::shared_ptr<PreparedQueryOperation> Connection::beginPreparedQuery(
+    std::unique_ptr<Connection> conn,
+    Query&& query) {
+  return beginAnyQuery<PreparedQueryOperation>(
+      Operation::ConnectionProxy(Operation::OwnedConnection(std::move(conn))),
+      std::move(query));
+}
+
 template <typename QueryType, typename QueryArg>
 std::shared_ptr<QueryType> Connection::beginAnyQuery(
     Operation::ConnectionProxy&& conn_proxy,
@@ -161,6 +170,12 @@ std::shared_ptr<QueryType> Connection::beginAnyQuery(
   }
 
   auto* conn = ret->connection();
+  if constexpr (std::is_base_of_v<FetchOperation, QueryType>) {
+    if (conn->conn_options_.getRenderQueriesInCaller()) {
+      // No operation is using the connection, it's safe to read its charset.
+      ret->renderQueries(conn->mysql_connection_->mysql());
+    }
+  }
   conn->mysql_client_->addOperation(ret);
   conn->socket_handler_.setOperation(ret.get());
   ret->setPreOperationCallback([conn](Operation& op) {
@@ -309,6 +324,36 @@ DbQueryResult Connection::query(Query&& query) {
   return Connection::query(std::move(query), QueryOptions());
 }
 
+template <>
+DbQueryResult Connection::preparedQuery(Query&& query) {
+  auto op = beginAnyQuery<PreparedQueryOperation>(
+      Operation::ConnectionProxy(Operation::ReferencedConnection(this)),
+      std::move(query));
+  SCOPE_EXIT {
+    operation_in_progress_ = false;
+  };
+  operation_in_progress_ = true;
+  op->run()->wait();
+
+  if (!op->ok()) {
+    throw QueryException(
+        0,
+        op->result(),
+        op->mysql_errno(),
+        op->mysql_error(),
+        *getKey(),
+        op->elapsed());
+  }
+  return DbQueryResult(
+      std::move(op->stealQueryResult()),
+      1,
+      op->resultSize(),
+      nullptr,
+      op->result(),
+      *getKey(),
+      op->elapsed());
+}
+
 template <>
 DbMultiQueryResult Connection::multiQuery(
     std::vector<Query>&& queries,
@@ -403,6 +448,9 @@ MultiQueryStreamHandler Connection::streamMultiQuery(
   if (timeout.count() > 0) {
     ret->setTimeout(timeout);
   }
+  if (ret->connection()->conn_options_.getRenderQueriesInCaller()) {
+    ret->renderQueries(ret->connection()->mysql_connection_->mysql());
+  }
   ret->connection()->mysql_client_->addOperation(ret);
   ret->connection()->socket_handler_.setOperation(ret.get());
 
@@ -23,6 +23,7 @@ namespace facebook::common::mysql_client {
 class QueryOperation;
 class MultiQueryOperation;
 class MultiQueryStreamOperation;
+class PreparedQueryOperation;
 
 using ConnectionDyingCallback =
     std::function<void(std::unique_ptr<MysqlConnectionHolder>)>;
@@ -107,6 +108,13 @@ class Connection {
       std::unique_ptr<Connection> conn,
       Args&&... args);
 
+  // Runs the query as a server side prepared statement, see
+  // PreparedQueryOperation. Arguments are the same as for beginQuery.
+  template <typename... Args>
+  static std::shared_ptr<PreparedQueryOperation> beginPreparedQuery(
+      std::unique_ptr<Connection> conn,
+      Args&&... args);
+
   FOLLY_NODISCARD static folly::SemiFuture<DbQueryResult> querySemiFuture(
       std::unique_ptr<Connection> conn,
       Query&& query,
@@ -172,6 +180,9 @@ class Connection {
   template <typename... Args>
   DbMultiQueryResult multiQuery(Args&&... args);
 
+  template <typename... Args>
+  DbQueryResult preparedQuery(Args&&... args);
+
   // EXPERIMENTAL
 
   // StreamResultHandler
@@ -493,6 +504,7 @@ class Connection {
   friend class QueryOperation;
   friend class MultiQueryOperation;
   friend class MultiQueryStreamOperation;
+  friend class PreparedQueryOperation;
   friend class SpecialOperation;
   friend class ResetOperation;
   friend class ChangeUserOperation;
@@ -613,6 +625,28 @@ std::shared_ptr<QueryOperation> Connection::beginQuery(
   return beginQuery(std::move(conn), std::move(query));
 }
 
+template <>
+std::shared_ptr<PreparedQueryOperation> Connection::beginPreparedQuery(
+    std::unique_ptr<Connection> conn,
+    Query&& query);
+
+template <typename... Args>
+std::shared_ptr<PreparedQueryOperation> Connection::beginPreparedQuery(
+    std::unique_ptr<Connection> conn,
+    Args&&... args) {
+  Query query{std::forward<Args>(args)...};
+  return beginPreparedQuery(std::move(conn), std::move(query));
+}
+
+template <>
+DbQueryResult Connection::preparedQuery(Query&& query);
+
+template <typename... Args>
+DbQueryResult Connection::preparedQuery(Args&&... args) {
+  Query query_obj{std::forward<Args>(args)...};
+  return preparedQuery(std::move(query_obj));
+}
+
 template <>
 [[deprecated("Replaced by the SemiFuture APIs")]] folly::Future<DbQueryResult>
 Connection::queryFuture(std::unique_ptr<Connection> conn, Query&& args);
@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/Format.h>
+#include <glog/logging.h>
+#include <re2/re2.h>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+#include "squangle/mysql_client/Row.h"
+
+using namespace facebook::common::mysql_client;
+
+using folly::runBenchmarks;
+
+// The regex based parsers Row.cpp used before, kept as the reference. The
+// old parseTimeOnly matched up to a NUL byte instead of the end of the
+// StringPiece; inputs here are NUL terminated so that makes no difference.
+std::chrono::microseconds regexParseTimeOnly(
+    folly::StringPiece mysql_time,
+    enum_field_types field_type) {
+  static re2::RE2 time_pattern(
+      "([-]?\\d{1,3}):(\\d{2}):(\\d{2})(?:\\.(\\d{1,6}))?");
+  int hours = 0, minutes = 0, seconds = 0, microseconds = 0;
+  std::string microseconds_str;
+  if (field_type != MYSQL_TYPE_TIME) {
+    throw std::range_error("No conversion available");
+  }
+
+  re2::StringPiece re2_mysql_time(mysql_time.data(), mysql_time.size());
+  if (!re2::RE2::FullMatch(
+          re2_mysql_time,
+          time_pattern,
+          &hours,
+          &minutes,
+          &seconds,
+          &microseconds_str)) {
+    throw std::range_error("Can't parse time");
+  }
+  if (!microseconds_str.empty()) {
+    microseconds_str.resize(6, '0');
+    microseconds = folly::to<int>(microseconds_str.c_str());
+  }
+  auto result = std::chrono::hours(hours) + std::chrono::minutes(minutes) +
+      std::chrono::seconds(seconds) + std::chrono::microseconds(microseconds);
+  return result;
+}
+
+std::chrono::system_clock::time_point regexParseDateTime(
+    folly::StringPiece datetime,
+    enum_field_types date_type) {
+  const int TM_YEAR_BASE = 1900;
+
+  // Clean struct and set daylight savings to information not available
+  struct tm time_tm = {0};
+
+  time_tm.tm_isdst = -1;
+  std::string microseconds_str;
+  int microseconds = 0;
+
+  bool parse_succeeded = false;
+  re2::StringPiece re2_datetime(datetime.data(), datetime.size());
+  switch (date_type) {
+    case MYSQL_TYPE_TIMESTAMP:
+    case MYSQL_TYPE_DATETIME:
+      static re2::RE2 timestamp_pattern(
+          "(\\d{4})-(\\d{2})-(\\d{2}) "
+          "(\\d{2}):(\\d{2}):(\\d{2})(?:\\.(\\d{1,6}))?");
+      parse_succeeded = re2::RE2::FullMatch(
+          re2_datetime,
+          timestamp_pattern,
+          &time_tm.tm_year,
+          &time_tm.tm_mon,
+          &time_tm.tm_mday,
+          &time_tm.tm_hour,
+          &time_tm.tm_min,
+          &time_tm.tm_sec,
+          &microseconds_str);
+      break;
+    case MYSQL_TYPE_DATE:
+      static re2::RE2 date_pattern("(\\d{4})-(\\d{2})-(\\d{2})");
+      parse_succeeded = re2::RE2::FullMatch(
+          re2_datetime,
+          date_pattern,
+          &time_tm.tm_year,
+          &time_tm.tm_mon,
+          &time_tm.tm_mday);
+      break;
+    default:
+      break;
+  };
+
+  if (!parse_succeeded) {
+    throw std::range_error("Can't parse date");
+  }
+  if (!microseconds_str.empty()) {
+    microseconds_str.resize(6, '0');
+    microseconds = folly::to<int>(microseconds_str.c_str());
+  }
+
+  if (time_tm.tm_year) {
+    time_tm.tm_year -= TM_YEAR_BASE;
+  }
+
+  if (time_tm.tm_mon) {
+    time_tm.tm_mon -= 1;
+  }
+
+  auto t = mktime(&time_tm);
+
+  if (t == -1) {
+    throw std::range_error("Date values are invalid");
+  }
+
+  auto chrono_time = std::chrono::system_clock::from_time_t(t);
+
+  chrono_time = chrono_time + std::chrono::microseconds(microseconds);
+  return chrono_time;
+}
+
+// Ten thousand consecutive timestamps a few seconds apart, like a time series.
+std::vector<std::string> datetimes;
+std::vector<std::string> dates;
+std::vector<std::string> times;
+
+template <typename Parse>
+void parseAll(
+    int iters,
+    const std::vector<std::string>& values,
+    enum_field_types type,
+    Parse parse) {
+  for (int i = 0; i < iters; ++i) {
+    for (const auto& value : values) {
+      folly::doNotOptimizeAway(parse(value, type));
+    }
+  }
+}
+
+void parseDateTimeWithRegex(
+    int iters,
+    const std::vector<std::string>& values,
+    enum_field_types type) {
+  parseAll(iters, values, type, regexParseDateTime);
+}
+
+void parseDateTimeWithParser(
+    int iters,
+    const std::vector<std::string>& values,
+    enum_field_types type) {
+  parseAll(iters, values, type, parseDateTime);
+}
+
+void parseTimeWithRegex(int iters, const std::vector<std::string>& values) {
+  parseAll(iters, values, MYSQL_TYPE_TIME, regexParseTimeOnly);
+}
+
+void parseTimeWithParser(int iters, const std::vector<std::string>& values) {
+  parseAll(iters, values, MYSQL_TYPE_TIME, parseTimeOnly);
+}
+
+BENCHMARK_NAMED_PARAM(
+    parseDateTimeWithRegex,
+    datetime,
+    datetimes,
+    MYSQL_TYPE_DATETIME);
+BENCHMARK_RELATIVE_NAMED_PARAM(
+    parseDateTimeWithParser,
+    datetime,
+    datetimes,
+    MYSQL_TYPE_DATETIME);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(parseDateTimeWithRegex, date, dates, MYSQL_TYPE_DATE);
+BENCHMARK_RELATIVE_NAMED_PARAM(
+    parseDateTimeWithParser,
+    date,
+    dates,
+    MYSQL_TYPE_DATE);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(parseTimeWithRegex, time, times);
+BENCHMARK_RELATIVE_NAMED_PARAM(parseTimeWithParser, time, times);
+BENCHMARK_DRAW_LINE();
+
+// Result of a parse, or nullopt if it threw. The messages have to match too.
+template <typename Result>
+std::pair<std::optional<Result>, std::string> tryParse(
+    const std::function<Result()>& parse) {
+  try {
+    return {parse(), ""};
+  } catch (const std::range_error& e) {
+    return {std::nullopt, e.what()};
+  }
+}
+
+void checkDateTime(const std::string& value, enum_field_types type) {
+  using TimePoint = std::chrono::system_clock::time_point;
+  auto expected = tryParse<TimePoint>(
+      [&]() { return regexParseDateTime(value, type); });
+  auto actual =
+      tryParse<TimePoint>([&]() { return parseDateTime(value, type); });
+  CHECK(expected == actual) << "'" << value << "' " << expected.second << " "
+                            << actual.second;
+}
+
+void checkTime(const std::string& value) {
+  using Micros = std::chrono::microseconds;
+  auto expected = tryParse<Micros>(
+      [&]() { return regexParseTimeOnly(value, MYSQL_TYPE_TIME); });
+  auto actual =
+      tryParse<Micros>([&]() { return parseTimeOnly(value, MYSQL_TYPE_TIME); });
+  CHECK(expected == actual) << "'" << value << "' " << expected.second << " "
+                            << actual.second;
+}
+
+// Every prefix of `value`, and every variant with one byte replaced or added.
+std::vector<std::string> mutations(const std::string& value) {
+  static const std::string kBytes("05 -:./a\xff");
+  std::vector<std::string> ret;
+  for (size_t i = 0; i <= value.size(); ++i) {
+    ret.push_back(value.substr(0, i));
+    for (char c : kBytes) {
+      if (i < value.size()) {
+        auto replaced = value;
+        replaced[i] = c;
+        ret.push_back(replaced);
+      }
+      auto inserted = value;
+      inserted.insert(i, 1, c);
+      ret.push_back(inserted);
+    }
+  }
+  return ret;
+}
+
+// Compares both implementations in the local time zone, run with different
+// TZ values to cover other zones.
+void checkEquivalence() {
+  // Every day from 1900 to 2100, at a few times of the day and precisions.
+  const char* kTimes[] = {"00:00:00", "01:30:15", "12:34:56", "23:59:59"};
+  const char* kFractions[] = {"", ".5", ".000001", ".123456"};
+  for (int year = 1900; year <= 2100; ++year) {
+    for (int month = 1; month <= 12; ++month) {
+      for (int day = 1; day <= 31; ++day) {
+        auto date = folly::sformat("{:04d}-{:02d}-{:02d}", year, month, day);
+        checkDateTime(date, MYSQL_TYPE_DATE);
+        for (auto time : kTimes) {
+          for (auto fraction : kFractions) {
+            checkDateTime(
+                folly::to<std::string>(date, " ", time, fraction),
+                MYSQL_TYPE_DATETIME);
+          }
+        }
+      }
+    }
+  }
+
+  // Every second of days with DST transitions in common zones.
+  const char* kTransitionDays[] = {
+      "2021-03-14", "2021-11-07", "2021-03-28", "2021-10-31", "2021-04-04"};
+  for (auto day : kTransitionDays) {
+    for (int second = 0; second < 86400; ++second) {
+      checkDateTime(
+          folly::sformat(
+              "{} {:02d}:{:02d}:{:02d}",
+              day,
+              second / 3600,
+              second / 60 % 60,
+              second % 60),
+          MYSQL_TYPE_TIMESTAMP);
+    }
+  }
+
+  // Out of range parts, normalized by mktime.
+  for (int year : {0, 1, 1969, 1970, 2038, 9999}) {
+    for (int month : {0, 1, 12, 13, 99}) {
+      for (int day : {0, 1, 29, 31, 32, 99}) {
+        auto date = folly::sformat("{:04d}-{:02d}-{:02d}", year, month, day);
+        checkDateTime(date, MYSQL_TYPE_DATE);
+        for (int hour : {0, 23, 24, 99}) {
+          for (int minute : {0, 59, 60, 99}) {
+            for (int second : {0, 59, 60, 99}) {
+              checkDateTime(
+                  folly::sformat(
+                      "{} {:02d}:{:02d}:{:02d}", date, hour, minute, second),
+                  MYSQL_TYPE_DATETIME);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Every TIME value with a few seconds and precisions, and hours written
+  // with one to three digits.
+  for (int hour = -838; hour <= 838; ++hour) {
+    for (int minute = 0; minute < 60; ++minute) {
+      for (auto second : {"00", "07", "59"}) {
+        for (auto fraction : kFractions) {
+          auto sign = hour < 0 ? "-" : "";
+          for (auto format : {"{}{}:{:02d}:{}{}", "{}{:03d}:{:02d}:{}{}"}) {
+            checkTime(folly::sformat(
+                format, sign, std::abs(hour), minute, second, fraction));
+          }
+        }
+      }
+    }
+  }
+
+  // Malformed values.
+  auto malformed = mutations("2021-03-14 02:30:00.123456");
+  auto malformed_dates = mutations("1999-12-31");
+  malformed.insert(
+      malformed.end(), malformed_dates.begin(), malformed_dates.end());
+  for (const auto& value : malformed) {
+    for (auto type :
+         {MYSQL_TYPE_DATE, MYSQL_TYPE_DATETIME, MYSQL_TYPE_TIMESTAMP}) {
+      checkDateTime(value, type);
+    }
+  }
+  for (const auto& value : mutations("-123:45:59.999999")) {
+    checkTime(value);
+  }
+  checkDateTime("2021-03-14", MYSQL_TYPE_TIME);
+  checkTime("12:00:00");
+}
+
+// Values are formatted with the fractional digits of their field, like the
+// text protocol sends them.
+void checkFormat() {
+  MYSQL_TIME time{};
+  time.year = 2021;
+  time.month = 6;
+  time.day = 1;
+  time.hour = 12;
+  time.minute = 34;
+  time.second = 56;
+  time.second_part = 120000;
+  auto format = [&](enum_field_types type, unsigned decimals) {
+    char text[kMaxMysqlTimeLength];
+    return std::string(text, formatMysqlTime(time, type, decimals, text));
+  };
+  CHECK_EQ(format(MYSQL_TYPE_DATETIME, 0), "2021-06-01 12:34:56");
+  CHECK_EQ(format(MYSQL_TYPE_DATETIME, 3), "2021-06-01 12:34:56.120");
+  CHECK_EQ(format(MYSQL_TYPE_TIMESTAMP, 6), "2021-06-01 12:34:56.120000");
+  CHECK_EQ(format(MYSQL_TYPE_TIME, 2), "12:34:56.12");
+  CHECK_EQ(format(MYSQL_TYPE_DATE, 0), "2021-06-01");
+  CHECK_EQ(
+      format(MYSQL_TYPE_DATETIME, kUnknownDecimals),
+      "2021-06-01 12:34:56.120000");
+  time.second_part = 0;
+  CHECK_EQ(format(MYSQL_TYPE_DATETIME, 3), "2021-06-01 12:34:56.000");
+  CHECK_EQ(
+      format(MYSQL_TYPE_DATETIME, kUnknownDecimals), "2021-06-01 12:34:56");
+}
+
+int main(int /*argc*/, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+
+  for (int i = 0; i < 10000; ++i) {
+    auto second = 3 * i;
+    datetimes.push_back(folly::sformat(
+        "2021-06-{:02d} {:02d}:{:02d}:{:02d}.{:06d}",
+        1 + second / 86400,
+        second / 3600 % 24,
+        second / 60 % 60,
+        second % 60,
+        i * 7 % 1000000));
+    dates.push_back(folly::sformat(
+        "{:04d}-{:02d}-{:02d}", 2000 + i / 365, 1 + i / 28 % 12, 1 + i % 28));
+    times.push_back(folly::sformat(
+        "{:02d}:{:02d}:{:02d}", i / 3600 % 100, i / 60 % 60, i % 60));
+  }
+
+  checkEquivalence();
+  checkFormat();
+  runBenchmarks();
+  return 0;
+}
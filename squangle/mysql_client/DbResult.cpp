@@ -8,7 +8,10 @@
 
 #include "squangle/mysql_client/DbResult.h"
 
+#include <algorithm>
+#include <array>
 #include <ostream>
+#include <system_error>
 
 #include <folly/ScopeGuard.h>
 
@@ -94,9 +97,19 @@ QueryResult::QueryResult(QueryResult&& other) noexcept
       recv_gtid_(std::move(other.recv_gtid_)),
       resp_attrs_(std::move(other.resp_attrs_)),
       operation_result_(other.operation_result_),
-      row_blocks_(std::move(other.row_blocks_)) {
+      row_blocks_(std::move(other.row_blocks_)),
+      max_resident_bytes_(other.max_resident_bytes_),
+      memory_budget_(std::move(other.memory_budget_)),
+      spill_directory_(std::move(other.spill_directory_)),
+      spill_file_(std::move(other.spill_file_)),
+      resident_bytes_(other.resident_bytes_),
+      num_spilled_blocks_(other.num_spilled_blocks_),
+      spill_failed_(other.spill_failed_) {
   other.row_blocks_.clear();
   other.num_rows_ = 0;
+  other.max_resident_bytes_ = 0;
+  other.resident_bytes_ = 0;
+  other.num_spilled_blocks_ = 0;
 }
 
 QueryResult& QueryResult::operator=(QueryResult&& other) {
@@ -115,10 +128,108 @@ QueryResult& QueryResult::operator=(QueryResult&& other) {
     other.row_blocks_.clear();
     other.num_rows_ = 0;
     was_slow_ = other.was_slow_;
+
+    releaseMemoryCharge();
+    max_resident_bytes_ = other.max_resident_bytes_;
+    memory_budget_ = std::move(other.memory_budget_);
+    spill_directory_ = std::move(other.spill_directory_);
+    spill_file_ = std::move(other.spill_file_);
+    resident_bytes_ = other.resident_bytes_;
+    num_spilled_blocks_ = other.num_spilled_blocks_;
+    spill_failed_ = other.spill_failed_;
+    other.max_resident_bytes_ = 0;
+    other.resident_bytes_ = 0;
+    other.num_spilled_blocks_ = 0;
   }
   return *this;
 }
 
+void QueryResult::setMemoryLimit(
+    size_t max_resident_bytes,
+    std::shared_ptr<ResultMemoryBudget> budget,
+    std::string spill_directory) {
+  max_resident_bytes_ = max_resident_bytes;
+  if (spill_directory.empty() && budget) {
+    spill_directory = budget->spillDirectory();
+  }
+  memory_budget_ = std::move(budget);
+  spill_directory_ = std::move(spill_directory);
+}
+
+void QueryResult::chargeLastBlock() {
+  auto bytes = row_blocks_.back().allocatedBytes();
+  resident_bytes_ += bytes;
+  if (memory_budget_) {
+    memory_budget_->charge(bytes);
+  }
+
+  auto over_limit = [&] {
+    return (max_resident_bytes_ != 0 &&
+            resident_bytes_ > max_resident_bytes_) ||
+        (memory_budget_ && memory_budget_->exceeded());
+  };
+  // The last block is left in memory for the RowsFetched callback.
+  while (!spill_failed_ && over_limit() &&
+         num_spilled_blocks_ + 1 < row_blocks_.size()) {
+    auto& block = row_blocks_[num_spilled_blocks_];
+    auto before = block.allocatedBytes();
+    try {
+      if (!spill_file_) {
+        spill_file_ = std::make_unique<SpillFile>(spill_directory_);
+      }
+      block.spill(*spill_file_);
+    } catch (const std::system_error& e) {
+      LOG(ERROR) << "Failed to spill query result: " << e.what();
+      spill_failed_ = true;
+      break;
+    }
+    auto released = before - block.allocatedBytes();
+    resident_bytes_ -= released;
+    if (memory_budget_) {
+      memory_budget_->release(released);
+    }
+    ++num_spilled_blocks_;
+  }
+}
+
+void QueryResult::releaseMemoryCharge() {
+  if (memory_budget_) {
+    memory_budget_->release(resident_bytes_);
+  }
+  resident_bytes_ = 0;
+}
+
+std::vector<ColumnarBatch> QueryResult::toColumnar() const& {
+  std::vector<ColumnarBatch> batches;
+  batches.reserve(row_blocks_.size());
+  for (const auto& block : row_blocks_) {
+    batches.push_back(toColumnarBatch(block));
+  }
+  return batches;
+}
+
+std::vector<ColumnarBatch> QueryResult::toColumnar() && {
+  // Like stealRows, the blocks stay charged until the result is destroyed.
+  auto blocks = std::make_shared<std::vector<RowBlock>>(std::move(row_blocks_));
+  row_blocks_.clear();
+  num_rows_ = 0;
+  num_spilled_blocks_ = 0;
+  std::vector<ColumnarBatch> batches;
+  batches.reserve(blocks->size());
+  for (const auto& block : *blocks) {
+    batches.push_back(toColumnarBatch(block, blocks));
+  }
+  return batches;
+}
+
+void QueryResult::writeJson(JsonSink& sink) const {
+  JsonRowWriter writer(sink);
+  for (const auto& block : row_blocks_) {
+    writer.writeRows(block);
+  }
+  writer.finish();
+}
+
 bool QueryResult::ok() const {
   return (partial_ && operation_result_ == OperationResult::Unknown) ||
       operation_result_ == OperationResult::Succeeded;
@@ -270,14 +381,30 @@ const std::string& MultiQueryStreamHandler::mysql_error() const {
   return operation_->mysql_error();
 }
 
+void MultiQueryStreamHandler::setReadAhead(
+    size_t max_rows,
+    size_t max_bytes) {
+  CHECK_EQ(state_, State::RunQuery);
+  read_ahead_max_rows_ = max_rows;
+  read_ahead_max_bytes_ = max_bytes;
+}
+
 void MultiQueryStreamHandler::streamCallback(
     FetchOperation* op,
     StreamState op_state) {
   // Runs in IO Thread
   if (op_state == StreamState::InitQuery) {
+    // Batches still holding rows of the previous query keep their own
+    // reference to its fields.
+    read_ahead_fields_.reset();
     op->pauseForConsumer();
     state_ = State::InitResult;
   } else if (op_state == StreamState::RowsReady) {
+    if (readAheadEnabled()) {
+      // Notifies the consumer only when the batch is full.
+      bufferRows(op);
+      return;
+    }
     op->pauseForConsumer();
     state_ = State::ReadRows;
   } else if (op_state == StreamState::QueryEnded) {
@@ -298,10 +425,62 @@ void MultiQueryStreamHandler::streamCallback(
   op->connection()->notify();
 }
 
+void MultiQueryStreamHandler::bufferRows(FetchOperation* op) {
+  auto* row_stream = op->rowStream();
+  if (!read_ahead_fields_) {
+    read_ahead_fields_ = row_stream->getEphemeralRowFields()->copy();
+  }
+  std::array<EphemeralRow, FetchOperation::RowStream::kBatchSize> rows;
+  while (true) {
+    // Rows taken from the stream must be buffered, so never ask for more
+    // than the batch has room for.
+    auto room =
+        std::min(rows.size(), read_ahead_max_rows_ - fill_batch_.numRows());
+    size_t num_rows =
+        row_stream->nextBatch(folly::range(rows.data(), rows.data() + room));
+    for (size_t i = 0; i < num_rows; ++i) {
+      fill_batch_.append(rows[i], read_ahead_fields_);
+    }
+    if (fill_batch_.numRows() >= read_ahead_max_rows_ ||
+        fill_batch_.numBytes() >= read_ahead_max_bytes_) {
+      flushReadAhead(op);
+      return;
+    }
+    if (num_rows == 0) {
+      return;
+    }
+  }
+}
+
+void MultiQueryStreamHandler::flushReadAhead(FetchOperation* op) {
+  if (fill_batch_.numRows() == 0) {
+    return;
+  }
+  op->pauseForConsumer();
+  state_ = State::ReadRows;
+  op->connection()->notify();
+}
+
 folly::Optional<EphemeralRow> MultiQueryStreamHandler::fetchOneRow(
     StreamedQueryResult* result) {
   checkStreamedQueryResult(result);
+  // Rows already handed over by the IO thread are read without any
+  // synchronization.
+  if (!drain_batch_.empty()) {
+    return folly::Optional<EphemeralRow>(drain_batch_.consumeRow());
+  }
   connection()->wait();
+  if (fill_batch_.numRows() > 0) {
+    // The operation is either paused or done, so the IO thread is not
+    // touching the batch. Take it and let the IO thread fill the next one
+    // while we read this one.
+    drain_batch_.clear();
+    std::swap(drain_batch_, fill_batch_);
+    if (state_ == State::ReadRows) {
+      resumeOperation();
+    }
+    return folly::Optional<EphemeralRow>(drain_batch_.consumeRow());
+  }
   // Accepted states: ReadRows, ReadResult, OperationFailed
   if (state_ == State::ReadRows) {
     if (!operation_->rowStream()->hasNext()) {
@@ -328,12 +507,15 @@ folly::Optional<EphemeralRow> MultiQueryStreamHandler::fetchOneRow(
 void MultiQueryStreamHandler::fetchQueryEnd(StreamedQueryResult* result) {
   checkStreamedQueryResult(result);
   connection()->wait();
+  // Read-ahead may have buffered rows the consumer never read.
+  bool unread_rows = !drain_batch_.empty() || fill_batch_.numRows() > 0;
   // Accepted states: ReadResult, OperationFailed
-  if (state_ == State::ReadResult) {
+  if (state_ == State::ReadResult && !unread_rows) {
     handleQueryEnded(result);
   } else if (state_ == State::OperationFailed) {
     handleQueryFailed(result);
-  } else if (state_ != State::ReadRows || fetchOneRow(result)) {
+  } else if (
+      unread_rows || state_ != State::ReadRows || fetchOneRow(result)) {
     LOG(DFATAL) << "Expected end of query, but received " << toString(state_)
                 << ".";
     handleBadState();
@@ -352,11 +534,14 @@ void MultiQueryStreamHandler::handleQueryEnded(StreamedQueryResult* result) {
       operation_->currentRecvGtid(),
       operation_->currentRespAttrs());
   result->freeHandler();
+  drain_batch_.clear();
   resumeOperation();
 }
 
 void MultiQueryStreamHandler::handleQueryFailed(StreamedQueryResult* result) {
   DCHECK(exception_wrapper_);
+  drain_batch_.clear();
+  fill_batch_.clear();
   if (result) {
     result->setException(exception_wrapper_);
     result->freeHandler();
@@ -366,6 +551,8 @@ void MultiQueryStreamHandler::handleQueryFailed(StreamedQueryResult* result) {
 }
 
 void MultiQueryStreamHandler::handleBadState() {
+  drain_batch_.clear();
+  fill_batch_.clear();
   operation_->cancel();
   resumeOperation();
 }
@@ -412,6 +599,8 @@ MultiQueryStreamHandler::MultiQueryStreamHandler(
   // yet invoked nextQuery on it or if the operation
   // is done()
   CHECK(other.state_ == State::RunQuery || other.operation_->done());
+  read_ahead_max_rows_ = other.read_ahead_max_rows_;
+  read_ahead_max_bytes_ = other.read_ahead_max_bytes_;
   operation_ = std::move(other.operation_);
   other.operation_ = nullptr;
 }
@@ -432,6 +621,10 @@ Connection* MultiQueryStreamHandler::connection() const {
 EphemeralRowFields* StreamedQueryResult::getRowFields() const {
   CHECK(stream_handler_ != nullptr) << "Trying to get the row fileds after "
                                     << "query end";
+  if (auto* row_fields = stream_handler_->drain_batch_.getRowFields()) {
+    // The operation may be running while rows are read ahead.
+    return row_fields;
+  }
   return stream_handler_->operation_->rowStream()->getEphemeralRowFields();
 }
 } // namespace mysql_client
@@ -13,6 +13,9 @@
 #include "squangle/base/ConnectionKey.h"
 #include "squangle/base/ExceptionUtil.h"
 #include "squangle/logger/DBEventLogger.h"
+#include "squangle/mysql_client/ColumnarExport.h"
+#include "squangle/mysql_client/JsonWriter.h"
+#include "squangle/mysql_client/ResultMemoryBudget.h"
 #include "squangle/mysql_client/Row.h"
 
 #include <folly/Exception.h>
@@ -191,6 +194,20 @@ class FetchResult : public DbResult {
   uint64_t result_size_;
 };
 
+// A column of a QueryResult, see QueryResult::column.
+template <typename T>
+struct DecodedColumn {
+  // A value per row; NULLs and values that couldn't be converted are T().
+  std::vector<T> values;
+  // Bit N is set when row N is NULL.
+  std::vector<uint64_t> null_mask;
+  ColumnDecodeStatus status;
+
+  bool isNull(size_t row) const {
+    return (null_mask[row / 64] >> (row % 64)) & 1;
+  }
+};
+
 // A QueryResult encapsulates the data regarding a query, as rows fetched,
 // last insert id, etc.
 // It is intended to create a layer over a collection of RowBlock of the same
@@ -211,7 +228,9 @@ class QueryResult {
 
   explicit QueryResult(int queryNum);
 
-  ~QueryResult() {}
+  ~QueryResult() {
+    releaseMemoryCharge();
+  }
 
   // Move Constructor
   QueryResult(QueryResult&& other) noexcept;
@@ -266,6 +285,8 @@ class QueryResult {
         partial() && row_blocks_.size() == 1, db::OperationStateException);
     RowBlock ret(std::move(row_blocks_[0]));
     row_blocks_.clear();
+    releaseMemoryCharge();
+    num_spilled_blocks_ = 0;
     return ret;
   }
 
@@ -287,6 +308,8 @@ class QueryResult {
   void setRowBlocks(std::vector<RowBlock>&& row_blocks) {
     num_rows_ = 0;
     row_blocks_ = std::move(row_blocks);
+    releaseMemoryCharge();
+    num_spilled_blocks_ = 0;
     for (const auto& block : row_blocks_) {
       num_rows_ += block.numRows();
     }
@@ -349,6 +372,45 @@ class QueryResult {
     return row_blocks_.size();
   }
 
+  // Keeps the RowBlocks in memory within `max_resident_bytes`, if not 0,
+  // and within `budget`, if set, which they are charged to.  Past either,
+  // the oldest blocks but the last one are spilled to a temp file in
+  // `spill_directory` (or the budget's) and read back from there, see
+  // RowBlock::spill.  Applies to blocks appended after the call.  If a block
+  // can't be written it stays in memory and spilling stops for the result.
+  void setMemoryLimit(
+      size_t max_resident_bytes,
+      std::shared_ptr<ResultMemoryBudget> budget,
+      std::string spill_directory = "");
+
+  // Bytes of the blocks that aren't spilled, only tracked with a memory
+  // limit.  Blocks taken with stealRows stay counted, and charged to the
+  // budget, until the result is destroyed.
+  size_t residentBytes() const {
+    return resident_bytes_;
+  }
+
+  size_t numSpilledBlocks() const {
+    return num_spilled_blocks_;
+  }
+
+  // All values of a field, decoded with RowBlock::decodeColumn.  The field
+  // name is only looked up once.
+  template <typename T>
+  DecodedColumn<T> column(folly::StringPiece field_name) const;
+
+  // The result in the Arrow columnar format, a record batch per RowBlock,
+  // see ColumnarExport.h.  Batches of the first overload may point into the
+  // blocks, so the result must outlive them; the second one moves the blocks
+  // into the batches.
+  std::vector<ColumnarBatch> toColumnar() const&;
+  std::vector<ColumnarBatch> toColumnar() &&;
+
+  // Writes the rows as a JSON array of objects keyed by field name, see
+  // JsonRowWriter for how values are written.  Values go from the blocks
+  // straight to the sink, without building a folly::dynamic per value.
+  void writeJson(JsonSink& sink) const;
+
   // Function for easier lookup of single row result, in case the result has
   // more rows, it will throw exception
   Row getOnlyRow() const {
@@ -410,10 +472,15 @@ class QueryResult {
   void appendRowBlock(RowBlock&& block) {
     num_rows_ += block.numRows();
     row_blocks_.emplace_back(std::move(block));
+    if (max_resident_bytes_ != 0 || memory_budget_) {
+      chargeLastBlock();
+    }
   }
 
   void setPartialRows(RowBlock&& partial_row_blocks_) {
     row_blocks_.clear();
+    releaseMemoryCharge();
+    num_spilled_blocks_ = 0;
     num_rows_ = partial_row_blocks_.numRows();
     row_blocks_.emplace_back(std::move(partial_row_blocks_));
   }
@@ -426,6 +493,8 @@ class QueryResult {
   void assertOnlyRow() const {
     CHECK_THROW(numRows() == 1, std::out_of_range);
   }
+  void chargeLastBlock();
+  void releaseMemoryCharge();
   std::shared_ptr<RowFields> row_fields_info_;
   int query_num_;
   bool partial_;
@@ -440,8 +509,58 @@ class QueryResult {
   OperationResult operation_result_;
 
   std::vector<RowBlock> row_blocks_;
+
+  // See setMemoryLimit.  Blocks before row_blocks_[num_spilled_blocks_] are
+  // spilled, resident_bytes_ is what is charged to memory_budget_.
+  size_t max_resident_bytes_ = 0;
+  std::shared_ptr<ResultMemoryBudget> memory_budget_;
+  std::string spill_directory_;
+  std::unique_ptr<SpillFile> spill_file_;
+  size_t resident_bytes_ = 0;
+  size_t num_spilled_blocks_ = 0;
+  bool spill_failed_ = false;
 };
 
+template <typename T>
+DecodedColumn<T> QueryResult::column(folly::StringPiece field_name) const {
+  DecodedColumn<T> ret;
+  if (!row_fields_info_) {
+    throw std::out_of_range(folly::sformat("Invalid field: {}", field_name));
+  }
+  auto field_num = row_fields_info_->fieldIndex(field_name);
+  ret.values.resize(num_rows_);
+  ret.null_mask.resize((num_rows_ + 63) / 64);
+
+  std::vector<uint64_t> block_mask;
+  size_t offset = 0;
+  for (const auto& block : row_blocks_) {
+    auto num_rows = block.numRows();
+    block_mask.resize((num_rows + 63) / 64);
+    auto status = block.decodeColumn<T>(
+        field_num,
+        folly::Range<T*>(ret.values.data() + offset, num_rows),
+        folly::range(block_mask));
+
+    // Blocks don't start on a word boundary of the result's mask.
+    auto shift = offset % 64;
+    for (size_t i = 0; i < block_mask.size(); ++i) {
+      auto word = offset / 64 + i;
+      ret.null_mask[word] |= block_mask[i] << shift;
+      if (shift != 0 && word + 1 < ret.null_mask.size()) {
+        ret.null_mask[word + 1] |= block_mask[i] >> (64 - shift);
+      }
+    }
+
+    ret.status.num_nulls += status.num_nulls;
+    ret.status.num_errors += status.num_errors;
+    if (!ret.status.first_error_row && status.first_error_row) {
+      ret.status.first_error_row = offset + *status.first_error_row;
+    }
+    offset += num_rows;
+  }
+  return ret;
+}
+
 class FetchOperation;
 class MultiQueryStreamOperation;
 class StreamedQueryResult;
@@ -615,6 +734,14 @@ class MultiQueryStreamHandler {
   unsigned int mysql_errno() const;
   const std::string& mysql_error() const;
 
+  // Enables read-ahead: instead of handing each row over to the consumer
+  // thread, the IO thread copies rows into a batch and only wakes the
+  // consumer once `max_rows` rows or `max_bytes` bytes of row data are
+  // buffered, or no more rows are ready. While the consumer reads a batch
+  // the IO thread fills the next one, so at most two batches are held in
+  // memory. Must be called before the first `nextQuery`.
+  void setReadAhead(size_t max_rows, size_t max_bytes);
+
  private:
   friend class Connection;
   friend class StreamedQueryResult;
@@ -627,6 +754,18 @@ class MultiQueryStreamHandler {
 
   void streamCallback(FetchOperation* op, StreamState state);
 
+  bool readAheadEnabled() const {
+    return read_ahead_max_rows_ > 0;
+  }
+
+  // Runs in IO thread. Copies the ready rows into `fill_batch_` and pauses
+  // the operation for the consumer once the batch is full. The byte limit
+  // may be overshot by the rows of one RowStream::nextBatch call.
+  void bufferRows(FetchOperation* op);
+  // Runs in IO thread. Pauses the operation for the consumer if there are
+  // buffered rows.
+  void flushReadAhead(FetchOperation* op);
+
   std::atomic<State> state_{State::RunQuery};
 
   // Provider to StreamedQueryResult call
@@ -655,6 +794,18 @@ class MultiQueryStreamHandler {
 
   size_t curr_query_ = 0; // the current query whose results we are fetching
 
+  // Read-ahead limits, a zero `read_ahead_max_rows_` disables read-ahead.
+  size_t read_ahead_max_rows_ = 0;
+  size_t read_ahead_max_bytes_ = 0;
+  // Filled by the IO thread while the operation runs and swapped into
+  // `drain_batch_` by the consumer thread while the operation is paused.
+  StreamedRowBatch fill_batch_;
+  StreamedRowBatch drain_batch_;
+  // Copy of the current query's fields for its read-ahead rows, which may
+  // be read after the operation has freed the result. Only touched by the
+  // IO thread.
+  std::shared_ptr<EphemeralRowFields> read_ahead_fields_;
+
   std::shared_ptr<MultiQueryStreamOperation> operation_;
 };
 
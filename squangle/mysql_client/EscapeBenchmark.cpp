@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/Benchmark.h>
+#include <glog/logging.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "squangle/mysql_client/EscapeString.h"
+
+using namespace facebook::common::mysql_client;
+
+using folly::runBenchmarks;
+
+MYSQL* mysql = nullptr;
+
+// Long text without anything to escape, text with a quote every few words,
+// non ASCII text, and random binary data.
+std::string plainText;
+std::string quotedText;
+std::string utf8Text;
+std::string binaryData;
+
+void escapeWithLibrary(int iters, const std::string& value) {
+  for (int i = 0; i < iters; ++i) {
+    folly::fbstring dest;
+    dest.resize(2 * value.size() + 1);
+    auto size =
+        mysql_real_escape_string(mysql, &dest[0], value.data(), value.size());
+    dest.resize(size);
+    folly::doNotOptimizeAway(dest);
+  }
+}
+
+void escapeWithAppend(int iters, const std::string& value) {
+  for (int i = 0; i < iters; ++i) {
+    folly::fbstring dest;
+    appendEscaped(&dest, value, mysql);
+    folly::doNotOptimizeAway(dest);
+  }
+}
+
+BENCHMARK_NAMED_PARAM(escapeWithLibrary, plain, plainText);
+BENCHMARK_RELATIVE_NAMED_PARAM(escapeWithAppend, plain, plainText);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(escapeWithLibrary, quoted, quotedText);
+BENCHMARK_RELATIVE_NAMED_PARAM(escapeWithAppend, quoted, quotedText);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(escapeWithLibrary, utf8, utf8Text);
+BENCHMARK_RELATIVE_NAMED_PARAM(escapeWithAppend, utf8, utf8Text);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(escapeWithLibrary, binary, binaryData);
+BENCHMARK_RELATIVE_NAMED_PARAM(escapeWithAppend, binary, binaryData);
+BENCHMARK_DRAW_LINE();
+
+folly::fbstring libraryEscape(const std::string& value) {
+  folly::fbstring dest;
+  dest.resize(2 * value.size() + 1);
+  dest.resize(
+      mysql_real_escape_string(mysql, &dest[0], value.data(), value.size()));
+  return dest;
+}
+
+folly::fbstring singleByteLibraryEscape(const std::string& value) {
+  // mysql_escape_string escapes with the client's default charset, latin1.
+  folly::fbstring dest;
+  dest.resize(2 * value.size() + 1);
+  dest.resize(mysql_escape_string(&dest[0], value.data(), value.size()));
+  return dest;
+}
+
+// Compares our escaping with libmysqlclient on random inputs, including
+// invalid multibyte sequences and special characters at every position.
+void checkEscaping() {
+  auto charset = escapeCharsetFor(mysql);
+  CHECK(charset.has_value());
+
+  std::mt19937 rng(0);
+  const std::vector<std::string> pieces = {
+      "a",
+      "'",
+      "\"",
+      "\\",
+      std::string(1, '\0'),
+      "\n",
+      "\r",
+      "\032",
+      "\xc3\xa9",
+      "\xe2\x82\xac",
+      "\xf0\x9f\x98\x80",
+      "\xc3",
+      "\xe0\x80\x80",
+      "\xf4\x90\x80\x80",
+      "\xff"};
+  for (int i = 0; i < 100000; ++i) {
+    std::string value;
+    auto length = rng() % 64;
+    bool random_bytes = rng() % 2;
+    while (value.size() < length) {
+      if (random_bytes) {
+        value.push_back(static_cast<char>(rng() % 256));
+      } else {
+        value += pieces[rng() % pieces.size()];
+      }
+    }
+
+    folly::fbstring escaped("prefix");
+    appendEscaped(&escaped, value, *charset);
+    CHECK_EQ(escaped, "prefix" + libraryEscape(value)) << value;
+
+    folly::fbstring single_byte_escaped;
+    appendEscaped(&single_byte_escaped, value, EscapeCharset::SingleByte);
+    CHECK_EQ(single_byte_escaped, singleByteLibraryEscape(value)) << value;
+  }
+}
+
+int main(int /*argc*/, char** /*argv*/) {
+  mysql = mysql_init(nullptr);
+
+  for (int i = 0; i < 1000; ++i) {
+    plainText += "lorem ipsum dolor sit amet ";
+    quotedText += i % 4 ? "lorem ipsum " : "it's \"quoted\" ";
+    utf8Text += "l\xc3\xb6rem \xe2\x82\xac ipsum ";
+  }
+  std::mt19937 rng(0);
+  for (int i = 0; i < 16 * 1024; ++i) {
+    binaryData.push_back(static_cast<char>(rng() % 256));
+  }
+
+  checkEscaping();
+  runBenchmarks();
+
+  mysql_close(mysql);
+  return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "squangle/mysql_client/EscapeString.h"
+
+#include <array>
+#include <cstring>
+
+#include "squangle/mysql_client/ByteScan.h"
+
+namespace facebook::common::mysql_client {
+
+namespace {
+
+using detail::hasByte;
+using detail::kHighBits;
+
+// Whether the 8 bytes need to be looked at one by one: either they contain a
+// byte to escape or, for multibyte charsets, a non ASCII byte.
+inline bool needsScan(uint64_t word, bool multibyte) {
+  return hasByte(word, '\0') | hasByte(word, '\n') | hasByte(word, '\r') |
+      hasByte(word, '\\') | hasByte(word, '\'') | hasByte(word, '"') |
+      hasByte(word, '\032') | (multibyte ? (word & kHighBits) : 0);
+}
+
+// Maps the bytes mysql_real_escape_string escapes to the character written
+// after the backslash, others map to 0.
+constexpr std::array<char, 256> makeEscapeTable() {
+  std::array<char, 256> table{};
+  table['\0'] = '0';
+  table['\n'] = 'n';
+  table['\r'] = 'r';
+  table['\\'] = '\\';
+  table['\''] = '\'';
+  table['"'] = '"';
+  table['\032'] = 'Z';
+  return table;
+}
+
+constexpr std::array<char, 256> kEscapeTable = makeEscapeTable();
+
+inline bool isContinuation(uint8_t c) {
+  return (c ^ 0x80) < 0x40;
+}
+
+// Length of the valid multibyte character starting at `p`, or 0 if there is
+// none. Same rules as libmysqlclient's my_ismbchar for utf8mb3/utf8mb4.
+size_t validMultibyteLength(const uint8_t* p, const uint8_t* end, bool mb4) {
+  uint8_t c = p[0];
+  if (c < 0xc2) {
+    return 0;
+  }
+  if (c < 0xe0) {
+    return (end - p >= 2 && isContinuation(p[1])) ? 2 : 0;
+  }
+  if (c < 0xf0) {
+    return (end - p >= 3 && isContinuation(p[1]) && isContinuation(p[2]) &&
+            (c >= 0xe1 || p[1] >= 0xa0))
+        ? 3
+        : 0;
+  }
+  if (mb4 && c < 0xf5) {
+    return (end - p >= 4 && isContinuation(p[1]) && isContinuation(p[2]) &&
+            isContinuation(p[3]) && (c >= 0xf1 || p[1] >= 0x90) &&
+            (c <= 0xf3 || p[1] <= 0x8f))
+        ? 4
+        : 0;
+  }
+  return 0;
+}
+
+// Whether `c` looks like the first byte of a multibyte character. Same rules
+// as libmysqlclient's my_mbcharlen(c) > 1 for utf8mb3/utf8mb4.
+inline bool isMultibyteHead(uint8_t c, bool mb4) {
+  return c >= 0xc2 && c < (mb4 ? 0xf8 : 0xf0);
+}
+
+} // namespace
+
+folly::Optional<EscapeCharset> escapeCharsetFor(MYSQL* mysql) {
+  if (mysql->server_status & SERVER_STATUS_NO_BACKSLASH_ESCAPES) {
+    return folly::none;
+  }
+  folly::StringPiece name(mysql_character_set_name(mysql));
+  if (name == "utf8mb4") {
+    return EscapeCharset::Utf8mb4;
+  }
+  if (name == "utf8mb3" || name == "utf8") {
+    return EscapeCharset::Utf8mb3;
+  }
+  if (name == "latin1" || name == "binary" || name == "ascii") {
+    return EscapeCharset::SingleByte;
+  }
+  return folly::none;
+}
+
+void appendEscaped(
+    folly::fbstring* dest,
+    folly::StringPiece value,
+    EscapeCharset charset) {
+  const bool multibyte = charset != EscapeCharset::SingleByte;
+  const bool mb4 = charset == EscapeCharset::Utf8mb4;
+  const auto* p = reinterpret_cast<const uint8_t*>(value.begin());
+  const auto* end = reinterpret_cast<const uint8_t*>(value.end());
+  // Start of the bytes seen but not yet appended to `dest`.
+  const auto* pending = p;
+
+  auto flush = [&]() {
+    dest->append(reinterpret_cast<const char*>(pending), p - pending);
+  };
+
+  dest->reserve(dest->size() + value.size());
+  while (p < end) {
+    // Skip runs with nothing to escape a word at a time.
+    while (end - p >= 8) {
+      uint64_t word;
+      std::memcpy(&word, p, sizeof(word));
+      if (needsScan(word, multibyte)) {
+        break;
+      }
+      p += 8;
+    }
+    if (p == end) {
+      break;
+    }
+
+    uint8_t c = *p;
+    char escape = kEscapeTable[c];
+    if (escape == 0 && multibyte && c >= 0x80) {
+      if (auto len = validMultibyteLength(p, end, mb4)) {
+        p += len;
+        continue;
+      }
+      // Escaped so an invalid sequence can't become valid with the byte
+      // following it.
+      if (isMultibyteHead(c, mb4)) {
+        escape = static_cast<char>(c);
+      }
+    }
+    if (escape == 0) {
+      ++p;
+      continue;
+    }
+
+    flush();
+    dest->push_back('\\');
+    dest->push_back(escape);
+    pending = ++p;
+  }
+  flush();
+}
+
+void appendEscaped(
+    folly::fbstring* dest,
+    folly::StringPiece value,
+    MYSQL* mysql) {
+  if (auto charset = escapeCharsetFor(mysql)) {
+    appendEscaped(dest, value, *charset);
+    return;
+  }
+
+  size_t old_size = dest->size();
+  dest->resize(old_size + 2 * value.size() + 1);
+  size_t actual_value_size = mysql_real_escape_string(
+      mysql, &(*dest)[old_size], value.data(), value.size());
+  dest->resize(old_size + actual_value_size);
+}
+
+} // namespace facebook::common::mysql_client
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/FBString.h>
+#include <folly/Optional.h>
+#include <folly/Range.h>
+
+#include <mysql.h> // @manual
+
+namespace facebook::common::mysql_client {
+
+// Character sets whose escaping we implement ourselves. For these, special
+// characters are always single ASCII bytes, so runs of bytes that need no
+// escaping can be skipped a word at a time.
+enum class EscapeCharset {
+  // latin1, ascii and binary
+  SingleByte,
+  // utf8 (utf8mb3)
+  Utf8mb3,
+  Utf8mb4,
+};
+
+// Returns how strings are escaped for the connection's current charset, or
+// none if only mysql_real_escape_string knows how to (other charsets or
+// NO_BACKSLASH_ESCAPES sql mode).
+folly::Optional<EscapeCharset> escapeCharsetFor(MYSQL* mysql);
+
+// Appends `value` to `dest`, producing the same bytes as
+// mysql_real_escape_string would for a connection using `charset`.
+void appendEscaped(
+    folly::fbstring* dest,
+    folly::StringPiece value,
+    EscapeCharset charset);
+
+// Appends `value` to `dest` escaped for the given connection, using the
+// version above when the connection's charset allows.
+void appendEscaped(
+    folly::fbstring* dest,
+    folly::StringPiece value,
+    MYSQL* mysql);
+
+} // namespace facebook::common::mysql_client
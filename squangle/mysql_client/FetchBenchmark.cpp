@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/Benchmark.h>
+#include <glog/logging.h>
+#include <array>
+#include <string>
+#include <vector>
+#include "squangle/mysql_client/Operation.h"
+
+using namespace facebook::common::mysql_client;
+
+using folly::runBenchmarks;
+
+constexpr size_t kNumRows = 100000;
+constexpr unsigned int kNumFields = 4;
+
+// Hands out the same row kNumRows times without any I/O, so only the cost of
+// the fetch loop is measured. Like the clients' handlers it is final, so
+// fetchReadyRows on its own type calls fetchRow directly.
+class FakeHandler final : public MysqlHandler {
+ public:
+  FakeHandler() : values_(kNumFields, "value"), row_(kNumFields) {
+    for (unsigned int i = 0; i < kNumFields; ++i) {
+      row_[i] = values_[i].data();
+    }
+    // Without `data`, mysql_fetch_lengths returns `lengths` as is.
+    res_.field_count = kNumFields;
+    res_.lengths = lengths_.data();
+    lengths_.fill(values_[0].size());
+  }
+
+  MYSQL_RES* result() {
+    return &res_;
+  }
+
+  void rewind() {
+    next_row_ = 0;
+  }
+
+  Status tryConnect(
+      MYSQL* /*mysql*/,
+      const ConnectionOptions& /*opts*/,
+      const ConnectionKey& /*key*/,
+      int /*flags*/) override {
+    return ERROR;
+  }
+  Status runQuery(MYSQL* /*mysql*/, folly::StringPiece /*query*/) override {
+    return ERROR;
+  }
+  MYSQL_RES* getResult(MYSQL* /*mysql*/) override {
+    return &res_;
+  }
+  Status nextResult(MYSQL* /*mysql*/) override {
+    return ERROR;
+  }
+  Status fetchRow(MYSQL_RES* res, MYSQL_ROW& row) override {
+    row = next_row_ < kNumRows ? row_.data() : nullptr;
+    res->current_row = row;
+    ++next_row_;
+    return DONE;
+  }
+  bool buffersResults() const override {
+    return true;
+  }
+  Status resetConn(MYSQL* /*mysql*/) override {
+    return ERROR;
+  }
+  Status changeUser(
+      MYSQL* /*mysql*/,
+      const std::string& /*user*/,
+      const std::string& /*password*/,
+      const std::string& /*database*/) override {
+    return ERROR;
+  }
+  Status prepareStatement(
+      MYSQL_STMT* /*stmt*/,
+      folly::StringPiece /*statement*/) override {
+    return ERROR;
+  }
+  Status executeStatement(MYSQL_STMT* /*stmt*/) override {
+    return ERROR;
+  }
+  Status fetchStatementRow(MYSQL_STMT* /*stmt*/, int& /*fetch_result*/)
+      override {
+    return ERROR;
+  }
+
+ private:
+  std::vector<std::string> values_;
+  std::vector<char*> row_;
+  std::array<unsigned long, kNumFields> lengths_;
+  MYSQL_RES res_{};
+  size_t next_row_ = 0;
+};
+
+// Fetches all rows in batches of `batch_size` like RowStream::nextBatch,
+// through the MysqlHandler interface or on the handler's own type.
+template <typename Handler>
+void fetchAll(size_t iters, size_t batch_size) {
+  folly::BenchmarkSuspender suspender;
+  FakeHandler fake;
+  // Hides the dynamic type, as the client's getMysqlHandler does.
+  Handler* handler = &fake;
+  folly::makeUnpredictable(handler);
+  std::array<MYSQL_ROW, FetchOperation::RowStream::kBatchSize> rows;
+  std::vector<unsigned long> lengths(rows.size() * kNumFields);
+  suspender.dismiss();
+  for (size_t i = 0; i < iters; ++i) {
+    fake.rewind();
+    bool finished = false;
+    size_t num_rows = 0;
+    while (!finished) {
+      num_rows += fetchReadyRows(
+          *handler,
+          fake.result(),
+          folly::range(rows.data(), rows.data() + batch_size),
+          lengths.data(),
+          finished);
+    }
+    CHECK_EQ(num_rows, kNumRows);
+  }
+}
+
+// Buffered results, whose rows are fetched a whole batch per call.
+BENCHMARK(virtualFetchRow, iters) {
+  fetchAll<MysqlHandler>(iters, FetchOperation::RowStream::kBatchSize);
+}
+BENCHMARK_RELATIVE(finalFetchRow, iters) {
+  fetchAll<FakeHandler>(iters, FetchOperation::RowStream::kBatchSize);
+}
+BENCHMARK_DRAW_LINE();
+
+// Unbuffered results, like all of the async client's: the library reuses
+// its buffer for every row, so nextBatch fetches one row per call and only
+// the virtual fetchRow inside the loop is saved.
+BENCHMARK(virtualFetchRowUnbuffered, iters) {
+  fetchAll<MysqlHandler>(iters, 1);
+}
+BENCHMARK_RELATIVE(finalFetchRowUnbuffered, iters) {
+  fetchAll<FakeHandler>(iters, 1);
+}
+
+int main(int /*argc*/, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/Format.h>
+#include <folly/json.h>
+#include <glog/logging.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "squangle/mysql_client/DbResult.h"
+#include "squangle/mysql_client/Row.h"
+
+using namespace facebook::common::mysql_client;
+
+using folly::runBenchmarks;
+
+constexpr size_t kNumRows = 10000;
+
+// A JSON column of documents like an event log's payloads, where readers
+// usually want a field or two. Every tenth value is NULL.
+std::unique_ptr<RowBlock> block;
+// A result like an API tier turns into a response: ids, names, scores,
+// timestamps and the payloads above, with quotes and newlines to escape.
+std::unique_ptr<QueryResult> result;
+
+std::string makeDocument(size_t i) {
+  return folly::sformat(
+      "{{\"event\": \"click\", \"ts\": {}, \"tags\": [\"a\", \"b\", \"c\"], "
+      "\"context\": {{\"page\": \"/home/{}\", \"referrer\": \"search\", "
+      "\"flags\": [true, false, null], \"score\": {}.5}}, "
+      "\"user\": {{\"name\": \"user\\u00e9{}\", \"id\": {}, "
+      "\"active\": {}}}}}",
+      1600000000 + i,
+      i % 100,
+      i % 7,
+      i,
+      i * 31,
+      i % 2 ? "true" : "false");
+}
+
+void makeBlock() {
+  auto fields = std::make_shared<RowFields>(
+      std::vector<std::string>{"payload"},
+      std::vector<std::string>{"events"},
+      std::vector<uint64_t>{0},
+      std::vector<enum_field_types>{MYSQL_TYPE_JSON});
+  block = std::make_unique<RowBlock>(fields);
+  for (size_t i = 0; i < kNumRows; ++i) {
+    block->startRow();
+    if (i % 10 == 0) {
+      block->appendNull();
+    } else {
+      block->appendValue(makeDocument(i));
+    }
+    block->finishRow();
+  }
+}
+
+void makeResult() {
+  auto fields = std::make_shared<RowFields>(
+      std::vector<std::string>{"id", "name", "score", "created", "payload"},
+      std::vector<std::string>(5, "events"),
+      std::vector<uint64_t>(5, 0),
+      std::vector<enum_field_types>{
+          MYSQL_TYPE_LONGLONG,
+          MYSQL_TYPE_VAR_STRING,
+          MYSQL_TYPE_DOUBLE,
+          MYSQL_TYPE_DATETIME,
+          MYSQL_TYPE_JSON});
+  RowBlock result_block(fields);
+  for (size_t i = 0; i < kNumRows; ++i) {
+    result_block.startRow();
+    result_block.appendValue(folly::to<std::string>(i * 31));
+    result_block.appendValue(
+        i % 5 ? folly::sformat("user {}", i) : "a \"quoted\"\nname");
+    if (i % 10 == 0) {
+      result_block.appendNull();
+    } else {
+      result_block.appendValue(folly::sformat("{}.25", i % 1000));
+    }
+    result_block.appendValue(folly::sformat(
+        "2021-06-{:02d} {:02d}:{:02d}:00", 1 + i % 28, i % 24, i % 60));
+    result_block.appendValue(makeDocument(i));
+    result_block.finishRow();
+  }
+  result = std::make_unique<QueryResult>(0);
+  result->setRowFields(fields);
+  result->appendRowBlock(std::move(result_block));
+}
+
+// What the API tier does today: a dynamic per value, then folly::toJson.
+folly::dynamic toDynamic(const QueryResult& query_result) {
+  auto rows = folly::dynamic::array();
+  for (const auto& row : query_result) {
+    auto object = folly::dynamic::object();
+    for (size_t i = 0; i < row.size(); ++i) {
+      object[query_result.getRowFields()->fieldName(i)] =
+          row.isNull(i) ? folly::dynamic(nullptr) : row.getDynamic(i);
+    }
+    rows.push_back(std::move(object));
+  }
+  return rows;
+}
+
+BENCHMARK(dynamicToJson, iters) {
+  for (size_t i = 0; i < iters; ++i) {
+    auto json = folly::toJson(toDynamic(*result));
+    folly::doNotOptimizeAway(json);
+  }
+}
+
+BENCHMARK_RELATIVE(writeJson, iters) {
+  for (size_t i = 0; i < iters; ++i) {
+    std::string json;
+    StringJsonSink sink(json);
+    result->writeJson(sink);
+    folly::doNotOptimizeAway(json);
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(dynamicUserId, iters) {
+  for (size_t i = 0; i < iters; ++i) {
+    int64_t sum = 0;
+    for (size_t row = 0; row < block->numRows(); ++row) {
+      auto value = block->getRow(row).getOptional<std::string>(0);
+      if (value) {
+        sum += folly::parseJson(*value)["user"]["id"].asInt();
+      }
+    }
+    folly::doNotOptimizeAway(sum);
+  }
+}
+
+BENCHMARK_RELATIVE(jsonViewUserId, iters) {
+  for (size_t i = 0; i < iters; ++i) {
+    int64_t sum = 0;
+    for (size_t row = 0; row < block->numRows(); ++row) {
+      auto id = block->getRow(row).getJson(0).find("$.user.id");
+      if (id) {
+        sum += id->as<int64_t>();
+      }
+    }
+    folly::doNotOptimizeAway(sum);
+  }
+}
+
+// Every value read through the view matches folly::parseJson.
+void checkEquivalence() {
+  for (size_t row = 0; row < block->numRows(); ++row) {
+    auto json = block->getRow(row).getJson(0);
+    if (block->isNull(row, 0)) {
+      CHECK(json.isNull());
+      CHECK(!json.find("$.user.id"));
+      continue;
+    }
+    auto dynamic = folly::parseJson(block->getField<std::string>(row, 0));
+    CHECK(json.toDynamic() == dynamic);
+    CHECK_EQ(
+        json.find("$.user.id")->as<int64_t>(),
+        dynamic["user"]["id"].asInt());
+    CHECK_EQ(
+        json.find("user.name")->as<std::string>(),
+        dynamic["user"]["name"].asString());
+    CHECK(!json.find("$.user.name")->stringPiece());
+    CHECK_EQ(
+        *json.find("$.\"context\".page")->stringPiece(),
+        dynamic["context"]["page"].asString());
+    CHECK_EQ(
+        json.find("$.context.score")->as<double>(),
+        dynamic["context"]["score"].asDouble());
+    CHECK_EQ(
+        json.find("$.user.active")->as<bool>(),
+        dynamic["user"]["active"].asBool());
+    CHECK(json.find("$.context.flags[2]")->isNull());
+    CHECK_EQ(
+        json.find("$.tags[1]")->as<std::string>(),
+        dynamic["tags"][1].asString());
+    CHECK(!json.find("$.tags[3]"));
+    CHECK(!json.find("$.missing.id"));
+    CHECK(json.get("tags")->type() == JsonView::Type::Array);
+  }
+}
+
+// The written JSON parses back to the dynamics the API tier builds, also
+// when the writer's buffer is flushed in the middle of values.
+void checkWriteJson() {
+  std::string json;
+  StringJsonSink sink(json);
+  result->writeJson(sink);
+  CHECK_GT(json.size(), JsonRowWriter::kBufferSize);
+  CHECK(folly::parseJson(json) == toDynamic(*result));
+
+  folly::IOBufQueue queue(folly::IOBufQueue::cacheChainLength());
+  IOBufJsonSink iobuf_sink(queue);
+  result->writeJson(iobuf_sink);
+  CHECK_EQ(queue.move()->moveToFbString().toStdString(), json);
+}
+
+int main(int /*argc*/, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  makeBlock();
+  makeResult();
+  checkEquivalence();
+  checkWriteJson();
+  runBenchmarks();
+  return 0;
+}
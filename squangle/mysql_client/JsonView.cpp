@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "squangle/mysql_client/JsonView.h"
+
+#include <folly/Format.h>
+#include <folly/Unicode.h>
+#include <folly/json.h>
+#include <stdexcept>
+
+namespace facebook {
+namespace common {
+namespace mysql_client {
+
+namespace {
+
+const folly::StringPiece kJsonNull("null");
+
+bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+[[noreturn]] void throwMalformed(folly::StringPiece what) {
+  throw std::invalid_argument(folly::sformat("Malformed JSON: {}", what));
+}
+
+[[noreturn]] void throwBadPath(folly::StringPiece path) {
+  throw std::invalid_argument(
+      folly::sformat("Invalid or unsupported JSON path: {}", path));
+}
+
+const char* skipSpace(const char* p, const char* end) {
+  while (p != end && isSpace(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+// Skips the string starting at the quote `p` points to, returning the end
+// of its closing quote.  Sets `escaped` if the string has escape sequences.
+const char* skipString(const char* p, const char* end, bool* escaped) {
+  ++p;
+  while (true) {
+    while (p != end && *p != '"' && *p != '\\') {
+      ++p;
+    }
+    if (p == end) {
+      throwMalformed("unterminated string");
+    }
+    if (*p == '"') {
+      return p + 1;
+    }
+    // The rest of a \u escape is plain characters.
+    if (end - p < 2) {
+      throwMalformed("unterminated string");
+    }
+    *escaped = true;
+    p += 2;
+  }
+}
+
+// Skips the value starting at `p`, returning its end.  Containers are only
+// matched by their brackets, the values inside them aren't checked.
+const char* skipValue(const char* p, const char* end) {
+  if (p == end) {
+    throwMalformed("missing value");
+  }
+  bool escaped = false;
+  if (*p == '"') {
+    return skipString(p, end, &escaped);
+  }
+  if (*p == '{' || *p == '[') {
+    size_t depth = 0;
+    while (p != end) {
+      switch (*p) {
+        case '"':
+          p = skipString(p, end, &escaped);
+          continue;
+        case '{':
+        case '[':
+          ++depth;
+          break;
+        case '}':
+        case ']':
+          if (--depth == 0) {
+            return p + 1;
+          }
+          break;
+        default:
+          break;
+      }
+      ++p;
+    }
+    throwMalformed("unterminated object or array");
+  }
+  // Numbers and literals end at the next delimiter.
+  const char* start = p;
+  while (p != end && !isSpace(*p) && *p != ',' && *p != ']' && *p != '}' &&
+         *p != ':') {
+    ++p;
+  }
+  if (p == start) {
+    throwMalformed(folly::sformat("unexpected '{}'", *p));
+  }
+  return p;
+}
+
+unsigned parseHex4(folly::StringPiece s, size_t pos) {
+  if (pos + 4 > s.size()) {
+    throwMalformed("truncated \\u escape");
+  }
+  unsigned value = 0;
+  for (size_t i = pos; i < pos + 4; ++i) {
+    char c = s[i];
+    unsigned digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      throwMalformed("bad \\u escape");
+    }
+    value = value * 16 + digit;
+  }
+  return value;
+}
+
+// The contents of a string with escape sequences, as UTF-8.
+std::string unescape(folly::StringPiece s) {
+  std::string out;
+  out.reserve(s.size());
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] != '\\') {
+      out.push_back(s[i]);
+      continue;
+    }
+    if (++i == s.size()) {
+      throwMalformed("bad escape");
+    }
+    switch (s[i]) {
+      case '"':
+      case '\\':
+      case '/':
+        out.push_back(s[i]);
+        break;
+      case 'b':
+        out.push_back('\b');
+        break;
+      case 'f':
+        out.push_back('\f');
+        break;
+      case 'n':
+        out.push_back('\n');
+        break;
+      case 'r':
+        out.push_back('\r');
+        break;
+      case 't':
+        out.push_back('\t');
+        break;
+      case 'u': {
+        char32_t code_point = parseHex4(s, i + 1);
+        i += 4;
+        // A high surrogate combines with the low surrogate escaped next.
+        if (code_point >= 0xD800 && code_point < 0xDC00 && i + 6 < s.size() &&
+            s[i + 1] == '\\' && s[i + 2] == 'u') {
+          char32_t low = parseHex4(s, i + 3);
+          if (low >= 0xDC00 && low < 0xE000) {
+            code_point = 0x10000 + ((code_point - 0xD800) << 10) +
+                (low - 0xDC00);
+            i += 6;
+          }
+        }
+        out += folly::codePointToUtf8(code_point);
+        break;
+      }
+      default:
+        throwMalformed("bad escape");
+    }
+  }
+  return out;
+}
+
+// Calls `fn(key, escaped, value)` with the raw key and value of every member
+// of `object` until it returns true.
+template <typename Fn>
+void forEachMember(folly::StringPiece object, Fn fn) {
+  const char* end = object.end();
+  const char* p = skipSpace(object.begin() + 1, end);
+  if (p != end && *p == '}') {
+    return;
+  }
+  while (true) {
+    if (p == end || *p != '"') {
+      throwMalformed("expected a key");
+    }
+    bool escaped = false;
+    const char* key_end = skipString(p, end, &escaped);
+    folly::StringPiece key(p + 1, key_end - 1);
+    p = skipSpace(key_end, end);
+    if (p == end || *p != ':') {
+      throwMalformed("expected ':'");
+    }
+    p = skipSpace(p + 1, end);
+    const char* value_end = skipValue(p, end);
+    if (fn(key, escaped, folly::StringPiece(p, value_end))) {
+      return;
+    }
+    p = skipSpace(value_end, end);
+    if (p != end && *p == ',') {
+      p = skipSpace(p + 1, end);
+    } else if (p != end && *p == '}') {
+      return;
+    } else {
+      throwMalformed("expected ',' or '}'");
+    }
+  }
+}
+
+// Same for the elements of `array`, with `fn(value)`.
+template <typename Fn>
+void forEachElement(folly::StringPiece array, Fn fn) {
+  const char* end = array.end();
+  const char* p = skipSpace(array.begin() + 1, end);
+  if (p != end && *p == ']') {
+    return;
+  }
+  while (true) {
+    const char* value_end = skipValue(p, end);
+    if (fn(folly::StringPiece(p, value_end))) {
+      return;
+    }
+    p = skipSpace(value_end, end);
+    if (p != end && *p == ',') {
+      p = skipSpace(p + 1, end);
+    } else if (p != end && *p == ']') {
+      return;
+    } else {
+      throwMalformed("expected ',' or ']'");
+    }
+  }
+}
+
+} // namespace
+
+JsonView::JsonView(folly::StringPiece json) {
+  const char* begin = skipSpace(json.begin(), json.end());
+  const char* end = json.end();
+  while (end != begin && isSpace(end[-1])) {
+    --end;
+  }
+  json_ = begin == end ? kJsonNull : folly::StringPiece(begin, end);
+}
+
+JsonView::Type JsonView::type() const {
+  switch (json_.front()) {
+    case 'n':
+      return Type::Null;
+    case 't':
+    case 'f':
+      return Type::Bool;
+    case '"':
+      return Type::String;
+    case '[':
+      return Type::Array;
+    case '{':
+      return Type::Object;
+    case '-':
+      return Type::Number;
+    default:
+      if (json_.front() >= '0' && json_.front() <= '9') {
+        return Type::Number;
+      }
+      throwMalformed(folly::sformat("unexpected '{}'", json_.front()));
+  }
+}
+
+std::optional<JsonView> JsonView::get(folly::StringPiece key) const {
+  if (type() != Type::Object) {
+    return std::nullopt;
+  }
+  std::optional<JsonView> found;
+  forEachMember(
+      json_,
+      [&](folly::StringPiece raw_key, bool escaped, folly::StringPiece value) {
+        bool match = escaped ? unescape(raw_key) == key : raw_key == key;
+        if (match) {
+          found = JsonView(value, Trimmed());
+        }
+        return match;
+      });
+  return found;
+}
+
+std::optional<JsonView> JsonView::at(size_t index) const {
+  if (type() != Type::Array) {
+    return std::nullopt;
+  }
+  std::optional<JsonView> found;
+  size_t i = 0;
+  forEachElement(json_, [&](folly::StringPiece value) {
+    if (i++ == index) {
+      found = JsonView(value, Trimmed());
+      return true;
+    }
+    return false;
+  });
+  return found;
+}
+
+std::optional<JsonView> JsonView::find(folly::StringPiece path) const {
+  const char* p = path.begin();
+  const char* end = path.end();
+  if (p != end && *p == '$') {
+    ++p;
+  }
+  // Without the `$`, the path may start with a member name.
+  const char* first = p == path.begin() ? p : nullptr;
+  std::optional<JsonView> current = *this;
+  while (p != end) {
+    if (*p == '.' || p == first) {
+      if (*p == '.') {
+        ++p;
+      }
+      if (p == end || *p == '*') {
+        throwBadPath(path);
+      }
+      if (*p == '"') {
+        bool escaped = false;
+        const char* key_end = skipString(p, end, &escaped);
+        folly::StringPiece key(p + 1, key_end - 1);
+        current = escaped ? current->get(unescape(key)) : current->get(key);
+        p = key_end;
+      } else {
+        const char* start = p;
+        while (p != end && *p != '.' && *p != '[') {
+          ++p;
+        }
+        current = current->get(folly::StringPiece(start, p));
+      }
+    } else if (*p == '[') {
+      const char* start = ++p;
+      while (p != end && *p >= '0' && *p <= '9') {
+        ++p;
+      }
+      if (p == start || p == end || *p != ']') {
+        throwBadPath(path);
+      }
+      current = current->at(folly::to<size_t>(folly::StringPiece(start, p)));
+      ++p;
+    } else {
+      throwBadPath(path);
+    }
+    if (!current) {
+      return std::nullopt;
+    }
+  }
+  return current;
+}
+
+std::optional<folly::StringPiece> JsonView::stringPiece() const {
+  if (type() != Type::String) {
+    throw std::range_error("JSON value is not a string");
+  }
+  bool escaped = false;
+  const char* end = skipString(json_.begin(), json_.end(), &escaped);
+  if (escaped) {
+    return std::nullopt;
+  }
+  return folly::StringPiece(json_.begin() + 1, end - 1);
+}
+
+std::string JsonView::stringValue() const {
+  if (type() != Type::String) {
+    throw std::range_error("JSON value is not a string");
+  }
+  bool escaped = false;
+  const char* end = skipString(json_.begin(), json_.end(), &escaped);
+  folly::StringPiece contents(json_.begin() + 1, end - 1);
+  return escaped ? unescape(contents) : contents.str();
+}
+
+folly::StringPiece JsonView::numberText() const {
+  if (type() != Type::Number) {
+    throw std::range_error("JSON value is not a number");
+  }
+  return json_;
+}
+
+bool JsonView::boolValue() const {
+  if (json_ == "true") {
+    return true;
+  }
+  if (json_ == "false") {
+    return false;
+  }
+  throw std::range_error("JSON value is not a boolean");
+}
+
+folly::dynamic JsonView::toDynamic() const {
+  return folly::parseJson(json_);
+}
+
+} // namespace mysql_client
+} // namespace common
+} // namespace facebook
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/Conv.h>
+#include <folly/Range.h>
+#include <folly/dynamic.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <type_traits>
+
+namespace facebook {
+namespace common {
+namespace mysql_client {
+
+// A read-only view of a JSON document, e.g. a value of a JSON column in a
+// RowBlock (see Row::getJson).  Nothing is parsed up front: lookups skim
+// over the text to the value they ask for, and scalars are converted only
+// when read, so looking up one key of a large document neither allocates
+// nor builds a folly::dynamic.  Only the parts of the document that are
+// walked over are checked; malformed JSON found on the way throws
+// std::invalid_argument.
+//
+// The view points into the text it was created from, which must outlive it.
+class JsonView {
+ public:
+  enum class Type {
+    Null,
+    Bool,
+    Number,
+    String,
+    Array,
+    Object,
+  };
+
+  // Leading and trailing whitespace is ignored.  Empty text, e.g. a NULL
+  // column, is viewed as JSON null.
+  explicit JsonView(folly::StringPiece json);
+
+  Type type() const;
+
+  bool isNull() const {
+    return type() == Type::Null;
+  }
+
+  // The member `key` of an object, nullopt if the object doesn't have it or
+  // this isn't an object.  With duplicate keys, the first one is returned.
+  std::optional<JsonView> get(folly::StringPiece key) const;
+
+  // Element `index` of an array, nullopt if it's out of range or this isn't
+  // an array.
+  std::optional<JsonView> at(size_t index) const;
+
+  // The value at a MySQL JSON path of members and array elements, like
+  // `$.user.tags[0]` or `$."key with spaces"`; the leading `$` is optional.
+  // nullopt if there is no such value.  Wildcards aren't supported and
+  // throw std::invalid_argument, like malformed paths.
+  std::optional<JsonView> find(folly::StringPiece path) const;
+
+  // The value converted to T, which may be bool, an arithmetic type (see
+  // folly::to) or std::string for strings.  Throws std::range_error if the
+  // value has another type or doesn't fit T.
+  template <typename T>
+  T as() const;
+
+  // The contents of a string without its quotes, nullopt if the string has
+  // escape sequences and has to be copied with as<std::string> instead.
+  // Throws std::range_error if this isn't a string.
+  std::optional<folly::StringPiece> stringPiece() const;
+
+  // The text of the value, e.g. to hand a sub-document to another parser.
+  folly::StringPiece raw() const {
+    return json_;
+  }
+
+  // Parses the value with folly::parseJson.
+  folly::dynamic toDynamic() const;
+
+ private:
+  // For values whose bounds are already known.
+  struct Trimmed {};
+  JsonView(folly::StringPiece json, Trimmed) : json_(json) {}
+
+  folly::StringPiece numberText() const;
+  bool boolValue() const;
+  std::string stringValue() const;
+
+  folly::StringPiece json_;
+};
+
+template <typename T>
+T JsonView::as() const {
+  if constexpr (std::is_same_v<T, bool>) {
+    return boolValue();
+  } else if constexpr (std::is_same_v<T, std::string>) {
+    return stringValue();
+  } else {
+    static_assert(std::is_arithmetic_v<T>, "Unsupported JSON conversion");
+    return folly::to<T>(numberText());
+  }
+}
+
+} // namespace mysql_client
+} // namespace common
+} // namespace facebook
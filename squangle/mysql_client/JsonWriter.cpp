@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "squangle/mysql_client/JsonWriter.h"
+
+#include <folly/json.h>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+#include "squangle/mysql_client/ByteScan.h"
+
+namespace facebook::common::mysql_client {
+
+namespace {
+
+using detail::hasByte;
+using detail::hasByteBelow;
+
+// Whether any of the 8 bytes has to be escaped in a JSON string.
+inline bool needsEscape(uint64_t word) {
+  return hasByte(word, '"') | hasByte(word, '\\') | hasByteBelow(word, 0x20);
+}
+
+// Maps the bytes with a short escape to the character written after the
+// backslash.  Other control characters map to 0 and are written as \u00XX.
+constexpr std::array<char, 256> makeEscapeTable() {
+  std::array<char, 256> table{};
+  table['"'] = '"';
+  table['\\'] = '\\';
+  table['\b'] = 'b';
+  table['\f'] = 'f';
+  table['\n'] = 'n';
+  table['\r'] = 'r';
+  table['\t'] = 't';
+  return table;
+}
+
+constexpr std::array<char, 256> kEscapeTable = makeEscapeTable();
+
+bool isNumericType(enum_field_types type) {
+  switch (type) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_YEAR:
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+    case MYSQL_TYPE_DECIMAL:
+    case MYSQL_TYPE_NEWDECIMAL:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Whether `value` is a number in JSON's grammar, which unlike MySQL's
+// doesn't allow leading zeros or a leading '+'.
+bool isJsonNumber(folly::StringPiece value) {
+  const char* p = value.begin();
+  const char* end = value.end();
+  auto skipDigits = [&]() {
+    const char* start = p;
+    while (p != end && *p >= '0' && *p <= '9') {
+      ++p;
+    }
+    return p != start;
+  };
+  if (p != end && *p == '-') {
+    ++p;
+  }
+  if (p != end && *p == '0') {
+    ++p;
+  } else if (!skipDigits()) {
+    return false;
+  }
+  if (p != end && *p == '.') {
+    ++p;
+    if (!skipDigits()) {
+      return false;
+    }
+  }
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    ++p;
+    if (p != end && (*p == '+' || *p == '-')) {
+      ++p;
+    }
+    if (!skipDigits()) {
+      return false;
+    }
+  }
+  return p == end;
+}
+
+} // namespace
+
+JsonRowWriter::JsonRowWriter(JsonSink& sink) : sink_(sink) {
+  append('[');
+}
+
+void JsonRowWriter::flush() {
+  if (size_ > 0) {
+    sink_.write(folly::StringPiece(buffer_.data(), size_));
+    size_ = 0;
+  }
+}
+
+void JsonRowWriter::append(const char* data, size_t size) {
+  if (size > kBufferSize - size_) {
+    flush();
+    if (size >= kBufferSize) {
+      sink_.write(folly::StringPiece(data, size));
+      return;
+    }
+  }
+  std::memcpy(buffer_.data() + size_, data, size);
+  size_ += size;
+}
+
+template <typename T>
+void JsonRowWriter::appendNumber(T value) {
+  // Enough for any int64_t, uint64_t or shortest double.
+  char text[32];
+  auto result = std::to_chars(text, text + sizeof(text), value);
+  append(text, result.ptr - text);
+}
+
+void JsonRowWriter::appendString(folly::StringPiece value) {
+  const char* p = value.begin();
+  const char* end = value.end();
+  // Start of the bytes seen but not yet appended.
+  const char* pending = p;
+
+  append('"');
+  while (p < end) {
+    // Skip runs with nothing to escape a word at a time.
+    while (end - p >= 8) {
+      uint64_t word;
+      std::memcpy(&word, p, sizeof(word));
+      if (needsEscape(word)) {
+        break;
+      }
+      p += 8;
+    }
+    if (p == end) {
+      break;
+    }
+
+    auto c = static_cast<uint8_t>(*p);
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      ++p;
+      continue;
+    }
+    append(pending, p - pending);
+    if (char escape = kEscapeTable[c]) {
+      char text[] = {'\\', escape};
+      append(text, sizeof(text));
+    } else {
+      static constexpr char kHexDigits[] = "0123456789abcdef";
+      char text[] = {
+          '\\', 'u', '0', '0', kHexDigits[c >> 4], kHexDigits[c & 15]};
+      append(text, sizeof(text));
+    }
+    pending = ++p;
+  }
+  append(pending, p - pending);
+  append('"');
+}
+
+void JsonRowWriter::appendValue(
+    const RowBlock& block,
+    size_t row,
+    size_t field_num,
+    bool numeric) {
+  if (block.isNull(row, field_num)) {
+    append("null", 4);
+    return;
+  }
+  switch (block.getFieldStorage(field_num)) {
+    case FieldStorage::Text: {
+      auto value = block.getField<folly::StringPiece>(row, field_num);
+      if (numeric && isJsonNumber(value)) {
+        append(value);
+      } else {
+        appendString(value);
+      }
+      return;
+    }
+    case FieldStorage::Int64:
+      appendNumber(block.getNativeField<int64_t>(row, field_num));
+      return;
+    case FieldStorage::UInt64:
+      appendNumber(block.getNativeField<uint64_t>(row, field_num));
+      return;
+    case FieldStorage::Double: {
+      auto value = block.getNativeField<double>(row, field_num);
+      if (std::isfinite(value)) {
+        appendNumber(value);
+      } else {
+        append("null", 4);
+      }
+      return;
+    }
+    case FieldStorage::DateTime: {
+      char text[kMaxMysqlTimeLength];
+      auto size = formatMysqlTime(
+          block.getNativeField<MYSQL_TIME>(row, field_num),
+          block.getFieldType(field_num),
+          block.getFieldDecimals(field_num),
+          text);
+      appendString(folly::StringPiece(text, size));
+      return;
+    }
+  }
+}
+
+void JsonRowWriter::writeRows(const RowBlock& block) {
+  auto num_fields = block.numFields();
+  keys_.clear();
+  key_ends_.clear();
+  numeric_.clear();
+  folly::json::serialization_opts opts;
+  for (size_t field_num = 0; field_num < num_fields; ++field_num) {
+    folly::json::escapeString(block.fieldName(field_num), keys_, opts);
+    keys_.push_back(':');
+    key_ends_.push_back(keys_.size());
+    numeric_.push_back(isNumericType(block.getFieldType(field_num)));
+  }
+
+  for (size_t row = 0; row < block.numRows(); ++row) {
+    if (!first_row_) {
+      append(',');
+    }
+    first_row_ = false;
+    append('{');
+    size_t key_begin = 0;
+    for (size_t field_num = 0; field_num < num_fields; ++field_num) {
+      if (field_num > 0) {
+        append(',');
+      }
+      append(keys_.data() + key_begin, key_ends_[field_num] - key_begin);
+      key_begin = key_ends_[field_num];
+      appendValue(block, row, field_num, numeric_[field_num]);
+    }
+    append('}');
+  }
+}
+
+void JsonRowWriter::finish() {
+  append(']');
+  flush();
+}
+
+} // namespace facebook::common::mysql_client
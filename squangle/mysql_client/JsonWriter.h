@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/io/IOBufQueue.h>
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "squangle/mysql_client/Row.h"
+
+namespace facebook::common::mysql_client {
+
+// Where a JsonRowWriter writes to.  The writer buffers its output and hands
+// it over in chunks of up to JsonRowWriter::kBufferSize bytes, so there is
+// a virtual call per chunk, not per value.
+class JsonSink {
+ public:
+  virtual ~JsonSink() = default;
+  virtual void write(folly::StringPiece chunk) = 0;
+};
+
+class StringJsonSink final : public JsonSink {
+ public:
+  explicit StringJsonSink(std::string& out) : out_(out) {}
+
+  void write(folly::StringPiece chunk) override {
+    out_.append(chunk.data(), chunk.size());
+  }
+
+ private:
+  std::string& out_;
+};
+
+// E.g. for the body of a response.
+class IOBufJsonSink final : public JsonSink {
+ public:
+  explicit IOBufJsonSink(folly::IOBufQueue& queue) : queue_(queue) {}
+
+  void write(folly::StringPiece chunk) override {
+    queue_.append(chunk.data(), chunk.size());
+  }
+
+ private:
+  folly::IOBufQueue& queue_;
+};
+
+// Writes rows as a JSON array with an object per row, its members the
+// fields in order.  Values are written straight from the RowBlocks, like
+// folly::toJson would write their Row::getDynamic values but without
+// building them:
+//  - NULL is null.
+//  - Integer, FLOAT, DOUBLE and DECIMAL fields are numbers.  Text values
+//    are copied as is when they are valid JSON numbers and written as
+//    strings otherwise, e.g. those of ZEROFILL columns.  Doubles that
+//    aren't finite are null.  DECIMAL values keep all their digits, where
+//    getDynamic has them as strings.
+//  - Other fields are strings.  Bytes of binary fields are copied as is,
+//    so they may not be valid UTF-8.
+class JsonRowWriter {
+ public:
+  static constexpr size_t kBufferSize = 16384;
+
+  explicit JsonRowWriter(JsonSink& sink);
+
+  JsonRowWriter(const JsonRowWriter&) = delete;
+  JsonRowWriter& operator=(const JsonRowWriter&) = delete;
+
+  void writeRows(const RowBlock& block);
+
+  // Closes the array and hands the rest of the output to the sink.
+  void finish();
+
+ private:
+  void flush();
+  void append(const char* data, size_t size);
+  void append(folly::StringPiece value) {
+    append(value.data(), value.size());
+  }
+  void append(char c) {
+    if (size_ == kBufferSize) {
+      flush();
+    }
+    buffer_[size_++] = c;
+  }
+  template <typename T>
+  void appendNumber(T value);
+  void appendString(folly::StringPiece value);
+  void appendValue(
+      const RowBlock& block,
+      size_t row,
+      size_t field_num,
+      bool numeric);
+
+  JsonSink& sink_;
+  std::array<char, kBufferSize> buffer_;
+  size_t size_ = 0;
+  bool first_row_ = true;
+  // `"name":` of every field of the current block, and which of them are
+  // written as numbers.
+  std::string keys_;
+  std::vector<size_t> key_ends_;
+  std::vector<bool> numeric_;
+};
+
+} // namespace facebook::common::mysql_client
@@ -14,6 +14,8 @@
 #include "squangle/base/ConnectionKey.h"
 #include "squangle/logger/DBEventLogger.h"
 #include "squangle/mysql_client/Operation.h"
+#include "squangle/mysql_client/ResultMemoryBudget.h"
+#include "squangle/mysql_client/RowBufferPool.h"
 
 namespace facebook::common::mysql_client {
 
@@ -86,6 +88,25 @@ class MysqlClientBase {
     return dbCounter;
   }
 
+  // Pool the RowBlocks of this client's results take their buffers from,
+  // see RowBufferPool.  Unset by default, so every block grows its own
+  // buffer.  Only results of the Rows layout use it.
+  void setRowBufferPool(std::shared_ptr<RowBufferPool> pool) {
+    row_buffer_pool_ = std::move(pool);
+  }
+  const std::shared_ptr<RowBufferPool>& getRowBufferPool() const {
+    return row_buffer_pool_;
+  }
+
+  // Bounds the RowBlocks the QueryOperations of this client keep in memory
+  // together, spilling older blocks to disk past it.  Unset by default.
+  void setResultMemoryBudget(std::shared_ptr<ResultMemoryBudget> budget) {
+    result_memory_budget_ = std::move(budget);
+  }
+  const std::shared_ptr<ResultMemoryBudget>& getResultMemoryBudget() const {
+    return result_memory_budget_;
+  }
+
   void setConnectionCallback(ObserverCallback connection_cb) {
     if (connection_cb_) {
       auto old_cb = connection_cb_;
@@ -148,6 +169,8 @@ class MysqlClientBase {
   std::unique_ptr<db::SquangleLoggerBase> db_logger_;
   std::unique_ptr<db::DBCounterBase> client_stats_;
   ObserverCallback connection_cb_;
+  std::shared_ptr<RowBufferPool> row_buffer_pool_;
+  std::shared_ptr<ResultMemoryBudget> result_memory_budget_;
 };
 
 } // namespace facebook::common::mysql_client
@@ -36,7 +36,9 @@ MysqlConnectionHolder::MysqlConnectionHolder(
       creation_time_(from_holder->creation_time_),
       last_activity_time_(from_holder->last_activity_time_),
       connection_opened_(from_holder->connection_opened_),
-      can_reuse_(from_holder->can_reuse_) {
+      can_reuse_(from_holder->can_reuse_),
+      stmt_cache_(std::move(from_holder->stmt_cache_)),
+      schema_cache_(std::move(from_holder->schema_cache_)) {
   mysql_ = from_holder->stealMysql();
   client_->activeConnectionAdded(&conn_key_);
 }
@@ -48,11 +50,15 @@ bool MysqlConnectionHolder::inTransaction() {
 MysqlConnectionHolder::~MysqlConnectionHolder() {
   if (close_fd_on_destroy_ && mysql_) {
     // Close our connection in the thread from which it was created.
-    if (!client_->runInThread([mysql = mysql_]() {
+    if (!client_->runInThread([mysql = mysql_,
+                               stmt_cache = std::move(stmt_cache_)]() mutable {
           // Unregister server cert validation callback
           const void* callback{nullptr};
           mysql_options(mysql, MYSQL_OPT_TLS_CERT_CALLBACK, &callback);
           mysql_close(mysql);
+          // mysql_close detached the statements, so closing them now only
+          // frees their memory instead of sending COM_STMT_CLOSE for each.
+          stmt_cache.reset();
         })) {
       LOG(DFATAL)
           << "Mysql connection couldn't be closed: error in folly::EventBase";
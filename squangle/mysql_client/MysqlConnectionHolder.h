@@ -13,6 +13,8 @@
 #include "squangle/base/Base.h"
 #include "squangle/base/ConnectionKey.h"
 #include "squangle/logger/DBEventLogger.h"
+#include "squangle/mysql_client/PreparedStatementCache.h"
+#include "squangle/mysql_client/ResultSchemaCache.h"
 
 namespace facebook::common::mysql_client {
 
@@ -99,13 +101,39 @@ class MysqlConnectionHolder {
   }
 
   // Useful for removing the raw mysql connection and leaving this class to be
-  // destroyed without closing it
+  // destroyed without closing it. Cached statements are closed, the new owner
+  // doesn't know about them.
   MYSQL* stealMysql() {
+    stmt_cache_.reset();
     auto ret = mysql_;
     mysql_ = nullptr;
     return ret;
   }
 
+  // Server side prepared statements of this connection, created on first use
+  // with room for `max_size` statements.
+  PreparedStatementCache* getStatementCache(size_t max_size) {
+    if (!stmt_cache_) {
+      stmt_cache_ = std::make_unique<PreparedStatementCache>(max_size);
+    }
+    return stmt_cache_.get();
+  }
+
+  // Called once the server dropped all prepared statements of the connection
+  // (COM_RESET_CONNECTION, COM_CHANGE_USER).
+  void clearStatementCache() {
+    stmt_cache_.reset();
+  }
+
+  // RowFields of the results of this connection, created on first use with
+  // room for `max_size` schemas.
+  ResultSchemaCache* getSchemaCache(size_t max_size) {
+    if (!schema_cache_) {
+      schema_cache_ = std::make_unique<ResultSchemaCache>(max_size);
+    }
+    return schema_cache_.get();
+  }
+
   void setNeedResetBeforeReuse() {
     needResetBeforeReuse_ = true;
   }
@@ -138,6 +166,12 @@ class MysqlConnectionHolder {
 
   bool can_reuse_;
 
+  // Statements are bound to `mysql_` and move along with it between holders.
+  std::unique_ptr<PreparedStatementCache> stmt_cache_;
+  // Schemas are verified on every hit, so unlike statements they stay valid
+  // across COM_RESET_CONNECTION and COM_CHANGE_USER.
+  std::unique_ptr<ResultSchemaCache> schema_cache_;
+
   // copy not allowed
   MysqlConnectionHolder() = delete;
   MysqlConnectionHolder(const MysqlConnectionHolder&) = delete;
@@ -9,6 +9,10 @@
 #ifndef COMMON_ASYNC_MYSQL_HANDLER_H
 #define COMMON_ASYNC_MYSQL_HANDLER_H
 
+#include <folly/Range.h>
+
+#include <algorithm>
+
 namespace facebook {
 namespace common {
 namespace mysql_client {
@@ -35,14 +39,74 @@ class MysqlHandler {
   virtual MYSQL_RES* getResult(MYSQL* mysql) = 0;
   virtual Status nextResult(MYSQL* mysql) = 0;
   virtual Status fetchRow(MYSQL_RES* res, MYSQL_ROW& row) = 0;
+  // Fetches up to `rows.size()` rows that are ready, copying the lengths of
+  // each into `lengths`, a row after the other, since the library only keeps
+  // those of the last row. Returns how many were fetched and sets `finished`
+  // once the result ends. The default loops over `fetchRow`; the clients'
+  // handlers override it with `fetchReadyRows` on their own type, so only
+  // the batch is a virtual call. Rows of unbuffered results, e.g. all of
+  // the async client's, are asked for one at a time (see
+  // RowStream::nextBatch), which saves one of the two virtual calls per row.
+  virtual size_t fetchRows(
+      MYSQL_RES* res,
+      folly::Range<MYSQL_ROW*> rows,
+      unsigned long* lengths,
+      bool& finished);
+  // True if getResult reads the whole result set, like mysql_store_result,
+  // so its rows stay valid until the result is freed.
+  virtual bool buffersResults() const = 0;
   virtual Status resetConn(MYSQL* mysql) = 0;
   virtual Status changeUser(
       MYSQL* mysql,
       const std::string& user,
       const std::string& password,
       const std::string& database) = 0;
+
+  // Server side prepared statements. Once fetchStatementRow is DONE,
+  // `fetch_result` holds the return value of mysql_stmt_fetch: 0,
+  // MYSQL_NO_DATA or MYSQL_DATA_TRUNCATED.
+  virtual Status prepareStatement(
+      MYSQL_STMT* stmt,
+      folly::StringPiece statement) = 0;
+  virtual Status executeStatement(MYSQL_STMT* stmt) = 0;
+  virtual Status fetchStatementRow(MYSQL_STMT* stmt, int& fetch_result) = 0;
 };
 
+// The loop of MysqlHandler::fetchRows. With a final Handler, the calls to
+// `fetchRow` aren't virtual and can be inlined.
+template <typename Handler>
+size_t fetchReadyRows(
+    Handler& handler,
+    MYSQL_RES* res,
+    folly::Range<MYSQL_ROW*> rows,
+    unsigned long* lengths,
+    bool& finished) {
+  size_t num_fields = mysql_num_fields(res);
+  size_t count = 0;
+  while (count < rows.size()) {
+    MYSQL_ROW row;
+    if (handler.fetchRow(res, row) == MysqlHandler::PENDING) {
+      break;
+    }
+    if (row == nullptr) {
+      finished = true;
+      break;
+    }
+    std::copy_n(
+        mysql_fetch_lengths(res), num_fields, lengths + count * num_fields);
+    rows[count++] = row;
+  }
+  return count;
+}
+
+inline size_t MysqlHandler::fetchRows(
+    MYSQL_RES* res,
+    folly::Range<MYSQL_ROW*> rows,
+    unsigned long* lengths,
+    bool& finished) {
+  return fetchReadyRows(*this, res, rows, lengths, finished);
+}
+
 } // namespace mysql_client
 } // namespace common
 } // namespace facebook
@@ -7,12 +7,15 @@
  */
 
 #include <errmsg.h> // mysql
+#include <mysqld_error.h> // mysql
 #include <folly/Memory.h>
 #include <folly/experimental/StringKeyedUnorderedMap.h>
 #include <folly/small_vector.h>
 #include <folly/ssl/OpenSSLPtrTypes.h>
 #include <gflags/gflags.h>
 #include <mysql_async.h>
+#include <algorithm>
+#include <array>
 #include <cmath>
 
 #include "squangle/base/ExceptionUtil.h"
@@ -299,6 +302,26 @@ void Operation::snapshotMysqlErrors() {
   }
 }
 
+std::shared_ptr<RowFields> Operation::makeRowFields(
+    const EphemeralRowFields& fields,
+    const std::vector<size_t>* columns) {
+  auto cache_size = conn()->getConnectionOptions().getResultSchemaCacheSize();
+  if (cache_size == 0) {
+    return fields.makeBufferedFields(columns);
+  }
+  return conn()->mysqlConnection()->getSchemaCache(cache_size)->getRowFields(
+      fields, columns);
+}
+
+const std::shared_ptr<PooledChunkChain>& Operation::rowChunkChain() {
+  if (!row_chunk_chain_) {
+    if (const auto& pool = conn()->client()->getRowBufferPool()) {
+      row_chunk_chain_ = std::make_shared<PooledChunkChain>(pool);
+    }
+  }
+  return row_chunk_chain_;
+}
+
 void Operation::setAsyncClientError(
     folly::StringPiece msg,
     folly::StringPiece normalizeMsg) {
@@ -999,6 +1022,59 @@ FetchOperation* FetchOperation::setUseChecksum(bool useChecksum) noexcept {
   return this;
 }
 
+FetchOperation* FetchOperation::setColumnProjection(
+    std::vector<std::string> column_names) {
+  CHECK_THROW(state_ == OperationState::Unstarted, db::OperationStateException);
+  projection_names_ = std::move(column_names);
+  return this;
+}
+
+FetchOperation* FetchOperation::setRowFilter(RowFilter filter) {
+  CHECK_THROW(state_ == OperationState::Unstarted, db::OperationStateException);
+  row_filter_ = std::move(filter);
+  return this;
+}
+
+void FetchOperation::cancelFetch(
+    folly::StringPiece msg,
+    folly::StringPiece normalize_msg) {
+  setAsyncClientError(msg, normalize_msg);
+  // The rest of the result is never read, so the connection must be closed
+  // like for a cancelled query.
+  cancel_ = true;
+  active_fetch_action_ = FetchAction::CompleteOperation;
+}
+
+bool FetchOperation::resolveColumnProjection() {
+  if (projection_names_.empty()) {
+    return true;
+  }
+  auto* fields = current_row_stream_->getEphemeralRowFields();
+  projected_columns_.clear();
+  for (const auto& name : projection_names_) {
+    auto index = fields->fieldIndexOpt(name);
+    if (!index) {
+      cancelFetch(
+          folly::sformat("Projected column {} isn't in the result", name),
+          "Projected column isn't in the result");
+      return false;
+    }
+    projected_columns_.push_back(*index);
+  }
+  return true;
+}
+
+void FetchOperation::renderQueries(MYSQL* mysql) {
+  CHECK_THROW(
+      state() == OperationState::Unstarted, db::OperationStateException);
+  try {
+    rendered_query_ = queries_.renderQuery(mysql);
+    queries_rendered_ = true;
+  } catch (std::invalid_argument&) {
+    // Rendered again when running, to fail the operation the usual way.
+  }
+}
+
 bool FetchOperation::isStreamAccessAllowed() const {
   // XOR if isPaused or the caller is coming from IO Thread
   return isPaused() || isInEventBaseThread();
@@ -1019,7 +1095,9 @@ FetchOperation* FetchOperation::specializedRun() {
 void FetchOperation::specializedRunImpl() {
   try {
     MYSQL* mysql = conn()->mysql();
-    rendered_query_ = queries_.renderQuery(mysql);
+    if (!queries_rendered_) {
+      rendered_query_ = queries_.renderQuery(mysql);
+    }
 
     mysql_options(mysql, MYSQL_OPT_QUERY_ATTR_RESET, 0);
     for (const auto& [key, value] : attributes_) {
@@ -1060,7 +1138,7 @@ bool FetchOperation::setQueryAttribute(
 FetchOperation::RowStream::RowStream(
     MYSQL_RES* mysql_query_result,
     MysqlHandler* handler)
-    : mysql_query_result_(mysql_query_result),
+    : mysql_query_result_(mysql_query_result, MysqlResultDeleter()),
       row_fields_(
           mysql_fetch_fields(mysql_query_result),
           mysql_num_fields(mysql_query_result)),
@@ -1083,6 +1161,58 @@ bool FetchOperation::RowStream::hasNext() {
   return current_row_.has_value();
 }
 
+size_t FetchOperation::RowStream::nextBatch(
+    folly::Range<EphemeralRow*> rows) {
+  CHECK_THROW(mysql_query_result_ != nullptr, db::OperationStateException);
+  auto* res = mysql_query_result_.get();
+  size_t num_fields = row_fields_.numFields();
+  size_t max_rows = handler_->buffersResults() ? rows.size() : 1;
+  max_rows = std::min(max_rows, rows.size());
+  if (max_rows == 0) {
+    return 0;
+  }
+  batch_rows_.resize(max_rows);
+  batch_lengths_.resize(max_rows * num_fields);
+
+  // A row fetched by `hasNext` or the operation comes first, the lengths of
+  // the last row fetched are still those of the library.
+  size_t slurped = 0;
+  if (current_row_.has_value()) {
+    batch_rows_[0] = current_row_->mysql_row_;
+    std::copy_n(mysql_fetch_lengths(res), num_fields, batch_lengths_.data());
+    current_row_.reset();
+    slurped = 1;
+  }
+  size_t count = slurped;
+  if (count < max_rows && !query_finished_) {
+    count += handler_->fetchRows(
+        res,
+        folly::range(batch_rows_.data() + count, batch_rows_.data() + max_rows),
+        batch_lengths_.data() + count * num_fields,
+        query_finished_);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    rows[i] = EphemeralRow(
+        batch_rows_[i], &batch_lengths_[i * num_fields], &row_fields_);
+    // The slurped row was already counted.
+    if (i >= slurped) {
+      query_result_size_ += rows[i].calculateRowLength();
+      ++num_rows_seen_;
+    }
+  }
+  return count;
+}
+
+std::shared_ptr<MYSQL_RES> FetchOperation::RowStream::shareBufferedResult() {
+  if (!handler_->buffersResults()) {
+    return nullptr;
+  }
+  // Buffered rows don't need the connection, and the result may now outlive
+  // it.
+  mysql_query_result_->handle = nullptr;
+  return mysql_query_result_;
+}
+
 bool FetchOperation::RowStream::slurp() {
   CHECK_THROW(mysql_query_result_ != nullptr, db::OperationStateException);
   if (current_row_.has_value() || query_finished_) {
@@ -1256,6 +1386,9 @@ void FetchOperation::socketActionable() {
         if (num_fields > 0) {
           current_row_stream_.assign(RowStream(mysql_query_result, &handler));
           active_fetch_action_ = FetchAction::Fetch;
+          if (!resolveColumnProjection()) {
+            continue;
+          }
         } else {
           active_fetch_action_ = FetchAction::CompleteQuery;
         }
@@ -1287,6 +1420,15 @@ void FetchOperation::socketActionable() {
 
       // When the query finished, `is_ready` is true, but there are no rows.
       bool is_ready = current_row_stream_->slurp();
+      if (!is_ready || current_row_stream_->hasQueryFinished()) {
+        // Consumers buffering rows get a chance to pause and hand them over
+        // before we wait on the socket or complete the query. On resume the
+        // slurp is simply retried.
+        notifyRowsExhausted();
+        if (active_fetch_action_ == FetchAction::WaitForConsumer) {
+          continue;
+        }
+      }
       if (!is_ready) {
         waitForSocketActionable();
         break;
@@ -1365,9 +1507,21 @@ void FetchOperation::socketActionable() {
     // If `pause` is called during the operation callbacks, this the Action it
     // should come to.
     // It's not necessary to unregister the socket event,  so just cancel the
-    // timeout and wait for `resume` to be called.
+    // timeout and wait for `resume` to be called. Unless the operation waits
+    // on its own work, which still counts against its timeout.
     if (active_fetch_action_ == FetchAction::WaitForConsumer) {
-      conn()->socketHandler()->cancelTimeout();
+      if (!timesOutWhilePaused()) {
+        conn()->socketHandler()->cancelTimeout();
+        break;
+      }
+      auto end = timeout_ + start_time_;
+      auto now = chrono::steady_clock::now();
+      if (now >= end) {
+        timeoutTriggered();
+      } else {
+        conn()->socketHandler()->scheduleTimeout(
+            chrono::duration_cast<chrono::milliseconds>(end - now).count());
+      }
       break;
     }
   }
@@ -1402,9 +1556,15 @@ void FetchOperation::resume() {
 }
 
 namespace {
-void copyRowToRowBlock(RowBlock* block, const EphemeralRow& eph_row) {
+// Copies the `columns` of the row, or all if nullptr.
+void copyRowToRowBlock(
+    RowBlock* block,
+    const EphemeralRow& eph_row,
+    const std::vector<size_t>* columns) {
   block->startRow();
-  for (int i = 0; i < eph_row.numFields(); ++i) {
+  size_t num_values = columns ? columns->size() : eph_row.numFields();
+  for (size_t n = 0; n < num_values; ++n) {
+    auto i = columns ? (*columns)[n] : n;
     if (eph_row.isNull(i)) {
       block->appendNull();
     } else {
@@ -1414,25 +1574,106 @@ void copyRowToRowBlock(RowBlock* block, const EphemeralRow& eph_row) {
   block->finishRow();
 }
 
-RowBlock makeRowBlockFromStream(
+// Applies the connection's dictionary encoding to an empty block.
+void setDictionaryEncoding(RowBlock& block, const ConnectionOptions& options) {
+  if (options.getDictionaryMaxDistinct() > 0) {
+    block.setDictionaryEncoding(
+        options.getDictionaryMaxDistinct(), options.getDictionarySampleRows());
+  }
+}
+
+// An empty block for the rows of `row_stream`, pointing into the result
+// buffered by libmysqlclient when it can be adopted. Projected rows are
+// always copied, and so are rows of results with a memory limit: adopted
+// blocks share the whole buffered result, which neither their charge nor
+// spilling them accounts for.
+RowBlock makeRowBlockForStream(
     std::shared_ptr<RowFields> row_fields,
-    FetchOperation::RowStream* row_stream) {
-  RowBlock row_block(std::move(row_fields));
-  // Consume row_stream
-  while (row_stream->hasNext()) {
-    auto eph_row = row_stream->consumeRow();
-    copyRowToRowBlock(&row_block, eph_row);
+    FetchOperation* op,
+    const ConnectionOptions& options,
+    std::shared_ptr<PooledChunkChain> chain,
+    bool memory_limited = false) {
+  if (options.getAdoptBufferedResults() && !op->projectedColumns() &&
+      !memory_limited) {
+    if (auto result = op->rowStream()->shareBufferedResult()) {
+      return RowBlock(std::move(row_fields), std::move(result));
+    }
+  }
+  RowBlock block(
+      std::move(row_fields),
+      {},
+      options.getRowBlockLayout(),
+      std::move(chain));
+  setDictionaryEncoding(block, options);
+  return block;
+}
+
+// Bytes of the values of `eph_row` a block keeps, what the byte targets
+// and caps count. Same as StreamedRowBatch::valueBytes.
+size_t keptValueBytes(
+    const EphemeralRow& eph_row,
+    const std::vector<size_t>* columns) {
+  if (!columns) {
+    return eph_row.calculateRowLength();
+  }
+  size_t bytes = 0;
+  for (auto i : *columns) {
+    bytes += eph_row[i].size();
+  }
+  return bytes;
+}
+
+// Consumes the rows of the operation's stream into `block`, applying its
+// projection and filter. Returns the bytes of the values kept if
+// `count_bytes`, 0 otherwise.
+size_t appendRowsFromStream(
+    RowBlock* block,
+    FetchOperation* op,
+    bool count_bytes) {
+  auto* row_stream = op->rowStream();
+  const auto* columns = op->projectedColumns();
+  const auto& filter = op->rowFilter();
+  size_t bytes = 0;
+  std::array<EphemeralRow, FetchOperation::RowStream::kBatchSize> rows;
+  while (size_t num_rows = row_stream->nextBatch(folly::range(rows))) {
+    for (size_t i = 0; i < num_rows; ++i) {
+      const auto& eph_row = rows[i];
+      if (filter && !filter(*row_stream->getEphemeralRowFields(), eph_row)) {
+        continue;
+      }
+      if (count_bytes) {
+        bytes += keptValueBytes(eph_row, columns);
+      }
+      if (block->layout() == RowBlockLayout::External) {
+        block->appendExternalRow(eph_row);
+      } else {
+        copyRowToRowBlock(block, eph_row, columns);
+      }
+    }
   }
+  return bytes;
+}
+
+RowBlock makeRowBlockFromStream(
+    std::shared_ptr<RowFields> row_fields,
+    FetchOperation* op,
+    const ConnectionOptions& options,
+    std::shared_ptr<PooledChunkChain> chain) {
+  auto row_block = makeRowBlockForStream(
+      std::move(row_fields), op, options, std::move(chain));
+  appendRowsFromStream(&row_block, op, /*count_bytes=*/false);
   return row_block;
 }
 } // namespace
 
 void FetchOperation::specializedTimeoutTriggered() {
-  DCHECK(active_fetch_action_ != FetchAction::WaitForConsumer);
+  bool paused = active_fetch_action_ == FetchAction::WaitForConsumer;
+  DCHECK(!paused || timesOutWhilePaused());
   auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(
       chrono::steady_clock::now() - start_time_);
 
-  if (conn()->getKillOnQueryTimeout()) {
+  // While paused the server has already sent the whole result.
+  if (conn()->getKillOnQueryTimeout() && !paused) {
     killRunningQuery();
   }
 
@@ -1563,7 +1804,7 @@ void FetchOperation::mustSucceed() {
   }
 }
 
-void FetchOperation::killRunningQuery() {
+void Operation::killRunningQuery() {
   /*
    * Send kill command to terminate the current operation on the DB
    * Note that we use KILL <processlist_id> to kill the entire connection
@@ -1632,6 +1873,14 @@ void MultiQueryStreamOperation::notifyRowsReady() {
   invokeCallback(StreamState::RowsReady);
 }
 
+void MultiQueryStreamOperation::notifyRowsExhausted() {
+  // Only the handler buffers rows ahead of the consumer.
+  auto* handler = boost::get<MultiQueryStreamHandler*>(&stream_callback_);
+  if (handler != nullptr && *handler != nullptr) {
+    (*handler)->flushReadAhead(this);
+  }
+}
+
 void MultiQueryStreamOperation::notifyQuerySuccess(bool) {
   // Query Boundary, only for streaming to allow the user to read from the
   // connection.
@@ -1662,16 +1911,80 @@ void QueryOperation::notifyInitQuery() {
   auto* row_stream = rowStream();
   if (row_stream) {
     // Populate RowFields, this is the metadata of rows.
-    query_result_->setRowFields(
-        row_stream->getEphemeralRowFields()->makeBufferedFields());
+    query_result_->setRowFields(makeRowFields(
+        *row_stream->getEphemeralRowFields(), projectedColumns()));
+  }
+  const auto& budget = conn()->client()->getResultMemoryBudget();
+  if (result_memory_limit_ != 0 || budget) {
+    query_result_->setMemoryLimit(
+        result_memory_limit_, budget, spill_directory_);
   }
 }
 
 void QueryOperation::notifyRowsReady() {
   // QueryOperation acts as consumer of FetchOperation, and will buffer the
   // result.
-  auto row_block =
-      makeRowBlockFromStream(query_result_->getSharedRowFields(), rowStream());
+  if (conn()->getConnectionOptions().getRowConversionExecutor() &&
+      conn()->getEventBase() != nullptr) {
+    stageRowsForConversion();
+    checkResultCaps();
+    return;
+  }
+
+  if (!pending_block_) {
+    pending_block_ = makeRowBlockForStream(
+        query_result_->getSharedRowFields(),
+        this,
+        conn()->getConnectionOptions(),
+        rowChunkChain(),
+        result_memory_limit_ != 0 ||
+            conn()->client()->getResultMemoryBudget() != nullptr);
+  }
+  auto rows = pending_block_->numRows();
+  auto bytes = appendRowsFromStream(
+      &*pending_block_,
+      this,
+      /*count_bytes=*/target_block_bytes_ != 0 || max_result_bytes_ != 0);
+  fetched_rows_ += pending_block_->numRows() - rows;
+  fetched_bytes_ += bytes;
+  pending_block_bytes_ += bytes;
+  if (reachedTargetBlockSize(pending_block_->numRows(), pending_block_bytes_)) {
+    flushPendingBlock();
+  }
+  checkResultCaps();
+}
+
+void QueryOperation::checkResultCaps() {
+  if (max_result_rows_ != 0 && fetched_rows_ > max_result_rows_) {
+    cancelFetch(
+        folly::sformat(
+            "Query result has more than {} rows, the operation's cap",
+            max_result_rows_),
+        "Query result over its row cap");
+  } else if (max_result_bytes_ != 0 && fetched_bytes_ > max_result_bytes_) {
+    cancelFetch(
+        folly::sformat(
+            "Query result has more than {} bytes, the operation's cap",
+            max_result_bytes_),
+        "Query result over its byte cap");
+  }
+}
+
+bool QueryOperation::reachedTargetBlockSize(size_t rows, size_t bytes) const {
+  if (target_block_rows_ == 0 && target_block_bytes_ == 0) {
+    return true;
+  }
+  return (target_block_rows_ != 0 && rows >= target_block_rows_) ||
+      (target_block_bytes_ != 0 && bytes >= target_block_bytes_);
+}
+
+void QueryOperation::flushPendingBlock() {
+  if (!pending_block_) {
+    return;
+  }
+  auto row_block = std::move(*pending_block_);
+  pending_block_.reset();
+  pending_block_bytes_ = 0;
 
   // Empty result set
   if (row_block.numRows() == 0) {
@@ -1685,6 +1998,98 @@ void QueryOperation::notifyRowsReady() {
   }
 }
 
+void QueryOperation::stageRowsForConversion() {
+  auto* row_stream = rowStream();
+  auto* row_fields = row_stream->getEphemeralRowFields();
+  const auto& filter = rowFilter();
+  auto bytes = staged_rows_.valueBytes();
+  std::array<EphemeralRow, RowStream::kBatchSize> rows;
+  while (size_t num_rows = row_stream->nextBatch(folly::range(rows))) {
+    for (size_t i = 0; i < num_rows; ++i) {
+      if (!filter || filter(*row_fields, rows[i])) {
+        staged_rows_.append(rows[i], nullptr, projectedColumns());
+        ++fetched_rows_;
+      }
+    }
+  }
+  fetched_bytes_ += staged_rows_.valueBytes() - bytes;
+  if (staged_rows_.numRows() > 0 &&
+      reachedTargetBlockSize(
+          staged_rows_.numRows(), staged_rows_.valueBytes())) {
+    convertStagedRows();
+  }
+}
+
+void QueryOperation::convertStagedRows() {
+  if (staged_rows_.numRows() == 0) {
+    return;
+  }
+  if (!conversion_executor_) {
+    conversion_executor_ = folly::SerialExecutor::create(
+        conn()->getConnectionOptions().getRowConversionExecutor());
+  }
+  auto batch = std::move(staged_rows_);
+  staged_rows_.clear();
+  ++pending_conversions_;
+  conversion_executor_->add(
+      [self = getSharedPointer(),
+       client = conn()->client(),
+       row_fields = query_result_->getSharedRowFields(),
+       layout = conn()->getConnectionOptions().getRowBlockLayout(),
+       max_distinct = conn()->getConnectionOptions().getDictionaryMaxDistinct(),
+       sample_rows = conn()->getConnectionOptions().getDictionarySampleRows(),
+       chain = rowChunkChain(),
+       batch = std::move(batch)]() mutable {
+        RowBlock row_block(std::move(row_fields), {}, layout, std::move(chain));
+        if (max_distinct > 0) {
+          row_block.setDictionaryEncoding(max_distinct, sample_rows);
+        }
+        batch.appendTo(&row_block);
+        // The client thread runs these in the order they were added, which
+        // the serial executor keeps the same as the rows.
+        if (!client->runInThread([self,
+                                  row_block = std::move(row_block)]() mutable {
+              static_cast<QueryOperation*>(self.get())
+                  ->rowBlockConverted(std::move(row_block));
+            })) {
+          static_cast<QueryOperation*>(self.get())->conversionHandOffFailed();
+        }
+      });
+}
+
+void QueryOperation::conversionHandOffFailed() {
+  // Like cancel(), the client thread isn't running this operation anymore,
+  // so it is completed here. Only the first failed hand-off does so.
+  {
+    std::unique_lock<std::mutex> l(run_state_mutex_);
+    if (state_ == OperationState::Cancelling ||
+        state_ == OperationState::Completed) {
+      return;
+    }
+    state_ = OperationState::Cancelling;
+  }
+  setAsyncClientError("Converted rows couldn't be handed to the client thread");
+  completeOperationInner(OperationResult::Failed);
+}
+
+void QueryOperation::rowBlockConverted(RowBlock&& row_block) {
+  DCHECK(isInEventBaseThread());
+  --pending_conversions_;
+  // Rows arriving after a failure, cancellation or timeout are dropped.
+  if (state() != OperationState::Completed) {
+    query_result_->appendRowBlock(std::move(row_block));
+    if (buffered_query_callback_) {
+      buffered_query_callback_(
+          *this, query_result_.get(), QueryCallbackReason::RowsFetched);
+    }
+  }
+  if (pending_conversions_ == 0 && waiting_for_conversions_ &&
+      state() != OperationState::Completed) {
+    waiting_for_conversions_ = false;
+    resume();
+  }
+}
+
 void QueryOperation::notifyQuerySuccess(bool more_results) {
   if (more_results) {
     // Bad usage of QueryOperation, we are going to cancel the query
@@ -1692,6 +2097,15 @@ void QueryOperation::notifyQuerySuccess(bool more_results) {
     setFetchAction(FetchAction::CompleteOperation);
   }
 
+  // Rows held back for the target block size and rows still being
+  // converted must be added before the operation completes.
+  flushPendingBlock();
+  convertStagedRows();
+  if (pending_conversions_ > 0) {
+    waiting_for_conversions_ = true;
+    pauseForConsumer();
+  }
+
   query_result_->setOperationResult(OperationResult::Succeeded);
   query_result_->setNumRowsAffected(FetchOperation::currentAffectedRows());
   query_result_->setLastInsertId(FetchOperation::currentLastInsertId());
@@ -1706,6 +2120,9 @@ void QueryOperation::notifyQuerySuccess(bool more_results) {
 }
 
 void QueryOperation::notifyFailure(OperationResult result) {
+  // Rows read before the failure are still handed over, like they would
+  // have been without a target block size.
+  flushPendingBlock();
   // Next call will be to notify user
   query_result_->setOperationResult(result);
 }
@@ -1734,15 +2151,18 @@ void MultiQueryOperation::notifyInitQuery() {
   auto* row_stream = rowStream();
   if (row_stream) {
     // Populate RowFields, this is the metadata of rows.
-    current_query_result_->setRowFields(
-        row_stream->getEphemeralRowFields()->makeBufferedFields());
+    current_query_result_->setRowFields(makeRowFields(
+        *row_stream->getEphemeralRowFields(), projectedColumns()));
   }
 }
 
 void MultiQueryOperation::notifyRowsReady() {
   // Create buffered RowBlock
   auto row_block = makeRowBlockFromStream(
-      current_query_result_->getSharedRowFields(), rowStream());
+      current_query_result_->getSharedRowFields(),
+      this,
+      conn()->getConnectionOptions(),
+      rowChunkChain());
   if (row_block.numRows() == 0) {
     return;
   }
@@ -1798,11 +2218,492 @@ void MultiQueryOperation::notifyOperationCompleted(OperationResult result) {
 
 MultiQueryOperation::~MultiQueryOperation() {}
 
+namespace {
+// Result columns start with a buffer this size at most, columns that don't fit
+// are fetched again into a buffer of their length.
+constexpr unsigned long kMaxInitialColumnBufferSize = 256;
+
+// How a column of a binary protocol result is kept in RowBlock when typed
+// results are enabled. FLOAT stays text, since widening it to double would
+// change the value the text protocol reports.
+FieldStorage typedFieldStorage(const MYSQL_FIELD& field) {
+  switch (field.type) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_YEAR:
+      return (field.flags & UNSIGNED_FLAG) ? FieldStorage::UInt64
+                                           : FieldStorage::Int64;
+    case MYSQL_TYPE_DOUBLE:
+      return FieldStorage::Double;
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_TIMESTAMP:
+    case MYSQL_TYPE_TIME:
+      return FieldStorage::DateTime;
+    default:
+      return FieldStorage::Text;
+  }
+}
+} // namespace
+
+PreparedQueryOperation::PreparedQueryOperation(
+    ConnectionProxy&& conn,
+    Query&& query)
+    : Operation(std::move(conn)),
+      query_(std::move(query)),
+      query_result_(std::make_unique<QueryResult>(0)) {}
+
+PreparedQueryOperation::~PreparedQueryOperation() {}
+
+PreparedQueryOperation* PreparedQueryOperation::specializedRun() {
+  if (!connection()->runInThread(
+          this, &PreparedQueryOperation::specializedRunImpl)) {
+    completeOperationInner(OperationResult::Failed);
+  }
+
+  return this;
+}
+
+void PreparedQueryOperation::specializedRunImpl() {
+  try {
+    statement_ = query_.renderPreparedStatement(&param_codes_);
+  } catch (std::invalid_argument& e) {
+    setAsyncClientError(
+        std::string("Unable to parse Query: ") + e.what(),
+        "Unable to parse Query");
+    completeOperation(OperationResult::Failed);
+    return;
+  }
+
+  if (!lookupStatement()) {
+    setAsyncClientError("Failed to allocate prepared statement");
+    completeOperation(OperationResult::Failed);
+    return;
+  }
+  socketActionable();
+}
+
+bool PreparedQueryOperation::lookupStatement() {
+  auto* cache = conn()->mysqlConnection()->getStatementCache(
+      conn()->getConnectionOptions().getPreparedStatementCacheSize());
+  stmt_ = cache->find(statement_);
+  if (stmt_) {
+    statement_cache_hit_ = true;
+    action_ = StatementAction::Bind;
+    return true;
+  }
+
+  MysqlStmtUniquePtr stmt(mysql_stmt_init(conn()->mysql()));
+  if (!stmt) {
+    return false;
+  }
+  // Cached before it is prepared, so it is closed along with the connection if
+  // the operation times out or is cancelled while preparing.
+  stmt_ = cache->insert(statement_, std::move(stmt));
+  action_ = StatementAction::Prepare;
+  return true;
+}
+
+bool PreparedQueryOperation::bindParams() {
+  const auto& params = query_.getParams();
+  param_binds_.assign(param_codes_.size(), MYSQL_BIND{});
+  param_values_.resize(param_codes_.size());
+  for (size_t i = 0; i < param_codes_.size(); ++i) {
+    auto& bind = param_binds_[i];
+    const auto& param = params[i];
+    // Types were checked against the codes by renderPreparedStatement.
+    if (param.isNull()) {
+      bind.buffer_type = MYSQL_TYPE_NULL;
+    } else if (param.isString()) {
+      const auto& value = param.getString();
+      bind.buffer_type = MYSQL_TYPE_STRING;
+      bind.buffer = const_cast<char*>(value.data());
+      bind.buffer_length = value.size();
+    } else if (param.isDouble()) {
+      param_values_[i].double_value = param.getDouble();
+      bind.buffer_type = MYSQL_TYPE_DOUBLE;
+      bind.buffer = &param_values_[i].double_value;
+    } else {
+      param_values_[i].int_value =
+          param.isBool() ? param.getBool() : param.getInt();
+      bind.buffer_type = MYSQL_TYPE_LONGLONG;
+      bind.buffer = &param_values_[i].int_value;
+      bind.is_unsigned = param_codes_[i] == 'u';
+    }
+  }
+  return param_binds_.empty() ||
+      !mysql_stmt_bind_param(stmt_, param_binds_.data());
+}
+
+void PreparedQueryOperation::bindResult(
+    MYSQL_FIELD* fields,
+    size_t num_fields) {
+  bool typed = conn()->getConnectionOptions().getTypedPreparedResults();
+  result_columns_.assign(num_fields, ResultColumn{});
+  result_binds_.assign(num_fields, MYSQL_BIND{});
+  field_storage_.clear();
+  for (size_t i = 0; i < num_fields; ++i) {
+    auto& column = result_columns_[i];
+    auto& bind = result_binds_[i];
+    column.storage =
+        typed ? typedFieldStorage(fields[i]) : FieldStorage::Text;
+    switch (column.storage) {
+      case FieldStorage::Int64:
+      case FieldStorage::UInt64:
+        bind.buffer_type = MYSQL_TYPE_LONGLONG;
+        bind.buffer = &column.native.int_value;
+        bind.is_unsigned = column.storage == FieldStorage::UInt64;
+        break;
+      case FieldStorage::Double:
+        bind.buffer_type = MYSQL_TYPE_DOUBLE;
+        bind.buffer = &column.native.double_value;
+        break;
+      case FieldStorage::DateTime:
+        bind.buffer_type = fields[i].type;
+        bind.buffer = &column.native.time_value;
+        break;
+      case FieldStorage::Text:
+        // Converted to text by libmysqlclient, matching what the text
+        // protocol stores in RowBlock.
+        column.buffer.resize(std::clamp<unsigned long>(
+            fields[i].length, 1, kMaxInitialColumnBufferSize));
+        bind.buffer_type = MYSQL_TYPE_STRING;
+        bind.buffer = column.buffer.data();
+        bind.buffer_length = column.buffer.size();
+        break;
+    }
+    bind.length = &column.length;
+    bind.is_null = &column.is_null;
+    bind.error = &column.error;
+  }
+
+  // Blocks of results without native columns keep the plain text layout.
+  if (std::any_of(
+          result_columns_.begin(), result_columns_.end(), [](const auto& col) {
+            return col.storage != FieldStorage::Text;
+          })) {
+    for (const auto& column : result_columns_) {
+      field_storage_.push_back(column.storage);
+    }
+  }
+}
+
+bool PreparedQueryOperation::fetchTruncatedColumns() {
+  for (size_t i = 0; i < result_columns_.size(); ++i) {
+    auto& column = result_columns_[i];
+    if (column.is_null || column.storage != FieldStorage::Text ||
+        column.length <= column.buffer.size()) {
+      continue;
+    }
+    // Keep the larger buffer for the following rows.
+    column.buffer.resize(column.length);
+    auto& bind = result_binds_[i];
+    bind.buffer = column.buffer.data();
+    bind.buffer_length = column.buffer.size();
+    if (mysql_stmt_fetch_column(stmt_, &bind, i, 0)) {
+      return false;
+    }
+  }
+  return !mysql_stmt_bind_result(stmt_, result_binds_.data());
+}
+
+void PreparedQueryOperation::appendCurrentRow(RowBlock* block) {
+  block->startRow();
+  for (const auto& column : result_columns_) {
+    if (column.is_null) {
+      block->appendNull();
+      continue;
+    }
+    switch (column.storage) {
+      case FieldStorage::Int64:
+        block->appendNativeValue(column.native.int_value);
+        total_result_size_ += sizeof(int64_t);
+        break;
+      case FieldStorage::UInt64:
+        block->appendNativeValue(
+            static_cast<uint64_t>(column.native.int_value));
+        total_result_size_ += sizeof(uint64_t);
+        break;
+      case FieldStorage::Double:
+        block->appendNativeValue(column.native.double_value);
+        total_result_size_ += sizeof(double);
+        break;
+      case FieldStorage::DateTime:
+        block->appendNativeValue(column.native.time_value);
+        total_result_size_ += sizeof(MYSQL_TIME);
+        break;
+      case FieldStorage::Text:
+        block->appendValue(
+            folly::StringPiece(column.buffer.data(), column.length));
+        total_result_size_ += column.length;
+        break;
+    }
+  }
+  block->finishRow();
+  ++rows_received_;
+}
+
+void PreparedQueryOperation::notifyRowsReady(RowBlock&& block) {
+  if (block.numRows() == 0) {
+    return;
+  }
+
+  query_result_->appendRowBlock(std::move(block));
+  if (buffered_query_callback_) {
+    buffered_query_callback_(
+        *this, query_result_.get(), QueryCallbackReason::RowsFetched);
+  }
+}
+
+void PreparedQueryOperation::snapshotStatementErrors() {
+  mysql_errno_ = mysql_stmt_errno(stmt_);
+  if (mysql_errno_ == 0) {
+    snapshotMysqlErrors();
+    return;
+  }
+  mysql_error_ = mysql_stmt_error(stmt_);
+  mysql_normalize_error_ = mysql_error_;
+}
+
+void PreparedQueryOperation::socketActionable() {
+  DCHECK(isInEventBaseThread());
+
+  folly::stop_watch<Duration> sw;
+  auto logThreadBlockTimeGuard =
+      std::make_unique<OperationGuard>([&]() { logThreadBlockTime(sw); });
+
+  auto& handler = conn()->client()->getMysqlHandler();
+  auto* cache = conn()->mysqlConnection()->getStatementCache(
+      conn()->getConnectionOptions().getPreparedStatementCacheSize());
+
+  // Same flow as FetchOperation::socketActionable, with statements: prepare
+  // unless cached, execute, then read the rows of the single result.
+  if (action_ == StatementAction::Prepare) {
+    auto status = handler.prepareStatement(stmt_, statement_);
+    if (status == MysqlHandler::PENDING) {
+      waitForSocketActionable();
+      return;
+    }
+
+    if (status == MysqlHandler::ERROR) {
+      snapshotStatementErrors();
+      action_ = StatementAction::Complete;
+    } else if (mysql_stmt_param_count(stmt_) != param_codes_.size()) {
+      // A literal `?` in the format.
+      setAsyncClientError(
+          "Prepared statement placeholders don't match the query parameters");
+      action_ = StatementAction::Complete;
+    } else {
+      action_ = StatementAction::Bind;
+    }
+    if (action_ == StatementAction::Complete) {
+      // Nothing else may use a statement that failed to prepare.
+      cache->erase(statement_);
+      stmt_ = nullptr;
+    }
+  }
+
+  if (action_ == StatementAction::Bind) {
+    if (bindParams()) {
+      action_ = StatementAction::Execute;
+    } else {
+      snapshotStatementErrors();
+      action_ = StatementAction::Complete;
+    }
+  }
+
+  if (action_ == StatementAction::Execute) {
+    auto status = handler.executeStatement(stmt_);
+    if (status == MysqlHandler::PENDING) {
+      waitForSocketActionable();
+      return;
+    }
+    if (status == MysqlHandler::ERROR) {
+      snapshotStatementErrors();
+    }
+
+    if (mysql_errno_ == ER_UNKNOWN_STMT_HANDLER) {
+      // The server lost the statement, prepare it again next time.
+      cache->erase(statement_);
+      stmt_ = nullptr;
+    }
+    action_ = mysql_errno_ != 0 ? StatementAction::Complete
+                                : StatementAction::InitFetch;
+  }
+
+  if (action_ == StatementAction::InitFetch) {
+    auto num_fields = mysql_stmt_field_count(stmt_);
+    action_ = StatementAction::Complete;
+    if (num_fields > 0) {
+      // Only client side metadata, freed right after copying it.
+      MYSQL_RES* metadata = mysql_stmt_result_metadata(stmt_);
+      if (metadata == nullptr) {
+        snapshotStatementErrors();
+      } else {
+        auto* fields = mysql_fetch_fields(metadata);
+        query_result_->setRowFields(
+            makeRowFields(EphemeralRowFields(fields, num_fields)));
+        bindResult(fields, num_fields);
+        mysql_free_result(metadata);
+        if (mysql_stmt_bind_result(stmt_, result_binds_.data())) {
+          snapshotStatementErrors();
+        } else {
+          action_ = StatementAction::Fetch;
+        }
+      }
+    }
+  }
+
+  if (action_ == StatementAction::Fetch) {
+    RowBlock row_block(
+        query_result_->getSharedRowFields(),
+        field_storage_,
+        conn()->getConnectionOptions().getRowBlockLayout(),
+        rowChunkChain());
+    setDictionaryEncoding(row_block, conn()->getConnectionOptions());
+    while (true) {
+      int fetch_result = 0;
+      auto status = handler.fetchStatementRow(stmt_, fetch_result);
+      if (status == MysqlHandler::PENDING) {
+        // Hand over what was read so far before waiting for more.
+        notifyRowsReady(std::move(row_block));
+        waitForSocketActionable();
+        return;
+      }
+      if (status == MysqlHandler::ERROR ||
+          (fetch_result == MYSQL_DATA_TRUNCATED && !fetchTruncatedColumns())) {
+        snapshotStatementErrors();
+        break;
+      }
+      if (fetch_result == MYSQL_NO_DATA) {
+        break;
+      }
+      appendCurrentRow(&row_block);
+    }
+    notifyRowsReady(std::move(row_block));
+    action_ = StatementAction::Complete;
+  }
+
+  if (action_ == StatementAction::Complete) {
+    if (mysql_errno_ == 0) {
+      MYSQL* mysql = conn()->mysql();
+      query_result_->setNumRowsAffected(mysql_stmt_affected_rows(stmt_));
+      query_result_->setLastInsertId(mysql_stmt_insert_id(stmt_));
+      const char* data;
+      size_t length;
+      if (!mysql_session_track_get_first(
+              mysql, SESSION_TRACK_GTIDS, &data, &length)) {
+        query_result_->setRecvGtid(std::string(data, length));
+      }
+      query_result_->setWasSlow(mysql->server_status & SERVER_QUERY_WAS_SLOW);
+      query_result_->setOperationResult(OperationResult::Succeeded);
+      query_result_->setPartial(false);
+      // All rows were read, this only releases client memory.
+      mysql_stmt_free_result(stmt_);
+    }
+
+    logThreadBlockTimeGuard.reset();
+    completeOperation(
+        mysql_errno_ == 0 ? OperationResult::Succeeded
+                          : OperationResult::Failed);
+  }
+}
+
+void PreparedQueryOperation::specializedTimeoutTriggered() {
+  auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(
+      chrono::steady_clock::now() - start_time_);
+
+  if (conn()->getKillOnQueryTimeout()) {
+    killRunningQuery();
+  }
+
+  auto cbDelayUs = client()->callbackDelayMicrosAvg();
+  bool stalled = cbDelayUs >= kCallbackDelayStallThresholdUs;
+
+  std::vector<std::string> parts;
+  parts.push_back(fmt::format(
+      "[{}]({}) Query timed out",
+      static_cast<uint16_t>(
+          stalled ? SquangleErrno::SQ_ERRNO_QUERY_TIMEOUT_LOOP_STALLED
+                  : SquangleErrno::SQ_ERRNO_QUERY_TIMEOUT),
+      kErrorPrefix));
+  parts.push_back(fmt::format("({} rows seen)", rows_received_));
+  parts.push_back(timeoutMessage(delta));
+  if (stalled) {
+    parts.push_back(threadOverloadMessage(cbDelayUs));
+  }
+
+  // The connection is closed when the operation completes, taking its cached
+  // statements along.
+  setAsyncClientError(
+      CR_NET_READ_INTERRUPTED,
+      folly::join(" ", parts),
+      fmt::format("Query timed out{}", stalled ? " (loop stalled)" : ""));
+  completeOperation(OperationResult::TimedOut);
+}
+
+void PreparedQueryOperation::specializedCompleteOperation() {
+  db::QueryLoggingData logging_data(
+      getOperationType(),
+      elapsed(),
+      timeout_,
+      result_ == OperationResult::Succeeded ? 1 : 0,
+      statement_.toStdString(),
+      rows_received_,
+      total_result_size_,
+      false,
+      false,
+      attributes_,
+      AttributeMap(),
+      getMaxThreadBlockTime(),
+      getTotalThreadBlockTime(),
+      query_result_->wasSlow());
+  if (result_ == OperationResult::Succeeded) {
+    conn()->setLastActivityTime(chrono::steady_clock::now());
+    client()->logQuerySuccess(logging_data, *conn().get());
+  } else {
+    db::FailureReason reason = db::FailureReason::DATABASE_ERROR;
+    if (result_ == OperationResult::Cancelled) {
+      reason = db::FailureReason::CANCELLED;
+    } else if (result_ == OperationResult::TimedOut) {
+      reason = db::FailureReason::TIMEOUT;
+    }
+    client()->logQueryFailure(
+        logging_data, reason, mysql_errno(), mysql_error(), *conn().get());
+    query_result_->setOperationResult(result_);
+  }
+
+  // This frees the `Operation::wait()` call. We need to free it here because
+  // callback can stealConnection and we can't notify anymore.
+  conn()->notify();
+  if (buffered_query_callback_) {
+    auto reason =
+        (result_ == OperationResult::Succeeded ? QueryCallbackReason::Success
+                                               : QueryCallbackReason::Failure);
+    buffered_query_callback_(*this, query_result_.get(), reason);
+    // Release callback since no other callbacks will be made
+    buffered_query_callback_ = nullptr;
+  }
+}
+
+void PreparedQueryOperation::mustSucceed() {
+  run();
+  wait();
+  if (!ok()) {
+    throw db::RequiredOperationFailedException("Query failed: " + mysql_error_);
+  }
+}
+
 void SpecialOperation::socketActionable() {
   auto status = callMysqlHandler();
   if (status == MysqlHandler::PENDING) {
     waitForSocketActionable();
   } else {
+    // Resetting the connection or changing user drops its prepared statements.
+    conn()->mysqlConnection()->clearStatementCache();
     auto result = (status == MysqlHandler::DONE)
         ? OperationResult::Succeeded
         : OperationResult::Failed; // MysqlHandler::ERROR
@@ -45,11 +45,13 @@
 #include <vector>
 
 #include <folly/Exception.h>
+#include <folly/Executor.h>
 #include <folly/Function.h>
 #include <folly/Memory.h>
 #include <folly/String.h>
 #include <folly/Unit.h>
 #include <folly/dynamic.h>
+#include <folly/executors/SerialExecutor.h>
 #include <folly/futures/Future.h>
 #include <folly/io/async/AsyncTimeout.h>
 #include <folly/io/async/EventHandler.h>
@@ -76,6 +78,7 @@ class FetchOperation;
 class MultiQueryStreamOperation;
 class QueryOperation;
 class MultiQueryOperation;
+class PreparedQueryOperation;
 class ResetOperation;
 class SpecialOperation;
 class ChangeUserOperation;
@@ -125,6 +128,8 @@ using QueryCallback =
     std::function<void(QueryOperation&, QueryResult*, QueryCallbackReason)>;
 using MultiQueryCallback = std::function<
     void(MultiQueryOperation&, QueryResult*, QueryCallbackReason)>;
+using PreparedQueryCallback = std::function<
+    void(PreparedQueryOperation&, QueryResult*, QueryCallbackReason)>;
 using CertValidatorCallback = std::function<
     bool(X509* server_cert, const void* context, folly::StringPiece& errMsg)>;
 using SpecialOperationCallback =
@@ -280,6 +285,126 @@ class ConnectionOptions {
     return use_checksum_;
   }
 
+  // Renders and escapes queries on the thread submitting them instead of
+  // the client thread, so large queries don't block the event loop. The
+  // client thread only sends the rendered bytes.
+  ConnectionOptions& setRenderQueriesInCaller(bool render_in_caller) noexcept {
+    render_queries_in_caller_ = render_in_caller;
+    return *this;
+  }
+
+  FOLLY_NODISCARD bool getRenderQueriesInCaller() const noexcept {
+    return render_queries_in_caller_;
+  }
+
+  // Maximum number of server side prepared statements each connection keeps
+  // for PreparedQueryOperations. The least recently used one is closed when a
+  // new statement doesn't fit.
+  ConnectionOptions& setPreparedStatementCacheSize(size_t size) {
+    CHECK_THROW(size > 0, std::invalid_argument);
+    prepared_statement_cache_size_ = size;
+    return *this;
+  }
+
+  FOLLY_NODISCARD size_t getPreparedStatementCacheSize() const noexcept {
+    return prepared_statement_cache_size_;
+  }
+
+  // Maximum number of result schemas each connection keeps so results of
+  // queries with the same columns share their RowFields. 0 disables the
+  // cache and copies the metadata of every result.
+  ConnectionOptions& setResultSchemaCacheSize(size_t size) noexcept {
+    result_schema_cache_size_ = size;
+    return *this;
+  }
+
+  FOLLY_NODISCARD size_t getResultSchemaCacheSize() const noexcept {
+    return result_schema_cache_size_;
+  }
+
+  // Stores integer, DOUBLE and temporal columns of PreparedQueryOperation
+  // results in their binary protocol form, so RowBlock::getField on them
+  // doesn't parse text. Those columns can't be read as StringPiece, e.g.
+  // through Row::operator[], use getField<std::string> instead.
+  ConnectionOptions& setTypedPreparedResults(bool typed) noexcept {
+    typed_prepared_results_ = typed;
+    return *this;
+  }
+
+  FOLLY_NODISCARD bool getTypedPreparedResults() const noexcept {
+    return typed_prepared_results_;
+  }
+
+  // Layout of the RowBlocks buffered by QueryOperation, MultiQueryOperation
+  // and PreparedQueryOperation. External isn't allowed, see
+  // setAdoptBufferedResults instead, and neither is Mapped, see
+  // QueryOperation::setResultMemoryLimit.
+  ConnectionOptions& setRowBlockLayout(RowBlockLayout layout) {
+    CHECK_THROW(
+        layout != RowBlockLayout::External &&
+            layout != RowBlockLayout::Mapped,
+        std::invalid_argument);
+    row_block_layout_ = layout;
+    return *this;
+  }
+
+  FOLLY_NODISCARD RowBlockLayout getRowBlockLayout() const noexcept {
+    return row_block_layout_;
+  }
+
+  // Dictionary encodes the low cardinality string columns of the RowBlocks
+  // buffered by QueryOperation, MultiQueryOperation and
+  // PreparedQueryOperation, see RowBlock::setDictionaryEncoding. A
+  // `max_distinct` of 0 turns it off.
+  ConnectionOptions& setDictionaryEncoding(
+      size_t max_distinct,
+      size_t sample_rows = RowBlock::kDictionarySampleRows) {
+    CHECK_THROW(sample_rows > 0, std::invalid_argument);
+    dictionary_max_distinct_ = max_distinct;
+    dictionary_sample_rows_ = sample_rows;
+    return *this;
+  }
+
+  FOLLY_NODISCARD size_t getDictionaryMaxDistinct() const noexcept {
+    return dictionary_max_distinct_;
+  }
+
+  FOLLY_NODISCARD size_t getDictionarySampleRows() const noexcept {
+    return dictionary_sample_rows_;
+  }
+
+  // Lets QueryOperation and MultiQueryOperation point their RowBlocks into
+  // results buffered by libmysqlclient instead of copying every value. The
+  // result's memory is released once all of its RowBlocks are destroyed.
+  // Only the sync client buffers results (mysql_store_result); the async
+  // client reads rows from the connection's network buffer and still copies.
+  // Rows are copied as well for QueryOperations with a result memory limit
+  // or a client ResultMemoryBudget, which can't account for a shared result.
+  ConnectionOptions& setAdoptBufferedResults(bool adopt) noexcept {
+    adopt_buffered_results_ = adopt;
+    return *this;
+  }
+
+  FOLLY_NODISCARD bool getAdoptBufferedResults() const noexcept {
+    return adopt_buffered_results_;
+  }
+
+  // Builds the RowBlocks of QueryOperations on `executor` instead of the
+  // client thread, which then only copies the raw rows off the connection.
+  // Blocks are still added and callbacks still run on the client thread, in
+  // the order the rows arrived, and the operation completes after the last
+  // block was added.  Only used by the async client.
+  ConnectionOptions& setRowConversionExecutor(
+      folly::Executor::KeepAlive<> executor) noexcept {
+    row_conversion_executor_ = std::move(executor);
+    return *this;
+  }
+
+  FOLLY_NODISCARD const folly::Executor::KeepAlive<>& getRowConversionExecutor()
+      const noexcept {
+    return row_conversion_executor_;
+  }
+
   // Sets the amount of attempts that will be tried in order to acquire the
   // connection. Each attempt will take at maximum the given timeout. To set
   // a global timeout that the operation shouldn't take more than, use
@@ -403,6 +528,15 @@ class ConnectionOptions {
   AttributeMap attributes_;
   folly::Optional<CompressionAlgorithm> compression_lib_;
   bool use_checksum_ = false;
+  bool render_queries_in_caller_ = false;
+  size_t prepared_statement_cache_size_ = 64;
+  size_t result_schema_cache_size_ = 32;
+  bool typed_prepared_results_ = false;
+  RowBlockLayout row_block_layout_ = RowBlockLayout::Rows;
+  size_t dictionary_max_distinct_ = 0;
+  size_t dictionary_sample_rows_ = RowBlock::kDictionarySampleRows;
+  bool adopt_buffered_results_ = false;
+  folly::Executor::KeepAlive<> row_conversion_executor_;
   uint32_t max_attempts_ = 1;
   folly::Optional<uint8_t> dscp_;
   folly::Optional<std::string> sni_servername_;
@@ -661,6 +795,16 @@ class Operation : public std::enable_shared_from_this<Operation> {
   // Connection before the user wants this information).
   void snapshotMysqlErrors();
 
+  // Buffered RowFields for a result, shared with earlier results of the
+  // connection with the same schema (see setResultSchemaCacheSize).
+  std::shared_ptr<RowFields> makeRowFields(
+      const EphemeralRowFields& fields,
+      const std::vector<size_t>* columns = nullptr);
+
+  // The chunks of the client's RowBufferPool the operation's blocks are
+  // copied into, shared by all of them. Null without a pool.
+  const std::shared_ptr<PooledChunkChain>& rowChunkChain();
+
   // Called when an Operation needs to wait for the socket to become
   // readable or writable (aka actionable).
   void waitForSocketActionable();
@@ -673,6 +817,10 @@ class Operation : public std::enable_shared_from_this<Operation> {
   // Called by ConnectionSocketHandler when the operation timed out
   void timeoutTriggered();
 
+  // Asynchronously kill a currently running query, returns
+  // before the query is killed
+  void killRunningQuery();
+
   // Our operation has completed.  During completeOperation,
   // specializedCompleteOperation is invoked for subclasses to perform
   // their own finalization (typically annotating errors and handling
@@ -778,6 +926,8 @@ class Operation : public std::enable_shared_from_this<Operation> {
   // Connection or query attributes (depending on the Operation type)
   AttributeMap attributes_;
 
+  std::shared_ptr<PooledChunkChain> row_chunk_chain_;
+
   // This mutex protects the operation cancel process when the state
   // is being checked in `run` and the operation is being cancelled in other
   // thread.
@@ -1126,12 +1276,36 @@ class FetchOperation : public Operation {
 
   FetchOperation* setUseChecksum(bool useChecksum) noexcept;
 
+  // Called with every row before QueryOperation or MultiQueryOperation
+  // buffer it, rows for which it returns false are skipped.
+  using RowFilter =
+      std::function<bool(const EphemeralRowFields&, const EphemeralRow&)>;
+
+  // Only buffer these columns of each result, in this order, instead of
+  // copying every value. A result missing one of them cancels the operation.
+  // Like `setRowFilter`, only used by QueryOperation and MultiQueryOperation,
+  // and must be called before the operation runs.
+  FetchOperation* setColumnProjection(std::vector<std::string> column_names);
+
+  FetchOperation* setRowFilter(RowFilter filter);
+
+  // Renders the queries in the calling thread, so that running the operation
+  // only needs to send them. Must be called before the operation runs and
+  // while no other operation is using the connection. On parse errors the
+  // queries are left unrendered, and the error is reported when running.
+  void renderQueries(MYSQL* mysql);
+
   // This class encapsulates the operations and access to the MySQL ResultSet.
   // When the consumer receives a notification for RowsFetched, it should
   // consume `rowStream`:
   //   while (rowStream->hasNext()) {
   //     EphemeralRow row = consumeRow();
   //   }
+  // or, a batch at a time:
+  //   std::array<EphemeralRow, RowStream::kBatchSize> rows;
+  //   while (size_t n = rowStream->nextBatch(folly::range(rows))) {
+  //     ...
+  //   }
   // The state within RowStream is also used for FetchOperation to know
   // whether or not to go to next query.
   class RowStream {
@@ -1142,10 +1316,26 @@ class FetchOperation : public Operation {
 
     bool hasNext();
 
+    // Rows consumers of the operations ask `nextBatch` for.
+    static constexpr size_t kBatchSize = 64;
+
+    // Fills `rows` with the rows that can be read without waiting on the
+    // socket and returns how many, 0 once none is ready. Rows of a result
+    // buffered by the client library (see MysqlHandler::buffersResults) stay
+    // valid until the next call; otherwise the library reuses its buffer for
+    // every row, so at most one row is returned. Can be mixed with `hasNext`
+    // and `consumeRow`.
+    size_t nextBatch(folly::Range<EphemeralRow*> rows);
+
     EphemeralRowFields* getEphemeralRowFields() {
       return &row_fields_;
     }
 
+    // Shares a buffered result (see MysqlHandler::buffersResults) with
+    // RowBlocks that point into its rows instead of copying them. Returns
+    // nullptr if the result isn't buffered.
+    std::shared_ptr<MYSQL_RES> shareBufferedResult();
+
     ~RowStream() = default;
     RowStream(RowStream&&) = default;
     RowStream& operator=(RowStream&&) = default;
@@ -1167,11 +1357,15 @@ class FetchOperation : public Operation {
 
     using MysqlResultDeleter =
         folly::static_function_deleter<MYSQL_RES, mysql_free_result>;
-    using MysqlResultUniquePtr = std::unique_ptr<MYSQL_RES, MysqlResultDeleter>;
 
-    // All memory lifetime is guaranteed by FetchOperation.
-    MysqlResultUniquePtr mysql_query_result_ = nullptr;
+    // All memory lifetime is guaranteed by FetchOperation, unless the result
+    // was shared with RowBlocks.
+    std::shared_ptr<MYSQL_RES> mysql_query_result_ = nullptr;
     folly::Optional<EphemeralRow> current_row_;
+    // Rows handed out by `nextBatch` and their lengths, which the library
+    // keeps only for the last row fetched.
+    std::vector<MYSQL_ROW> batch_rows_;
+    std::vector<unsigned long> batch_lengths_;
     EphemeralRowFields row_fields_;
     MysqlHandler* handler_ = nullptr;
   };
@@ -1198,6 +1392,16 @@ class FetchOperation : public Operation {
 
   RowStream* rowStream();
 
+  // Field numbers of the projected columns in the current result, or nullptr
+  // without a projection.
+  const std::vector<size_t>* projectedColumns() const {
+    return projection_names_.empty() ? nullptr : &projected_columns_;
+  }
+
+  const RowFilter& rowFilter() const {
+    return row_filter_;
+  }
+
   // Stalls the FetchOperation until `resume` is called.
   // This is used to allow another thread to access the socket functions.
   void pauseForConsumer();
@@ -1228,6 +1432,11 @@ class FetchOperation : public Operation {
   void setFetchAction(FetchAction action);
   static folly::StringPiece toString(FetchAction action);
 
+  // Stops reading the current result and completes the operation as
+  // cancelled with a client error, which closes the connection.  Only for
+  // the notify callbacks of the fetch loop.
+  void cancelFetch(folly::StringPiece msg, folly::StringPiece normalize_msg);
+
   // In socket actionable it is analyzed the action that is required to
   // continue the operation. For example, if the fetch action is StartQuery,
   // it runs query or requests more results depending if it had already ran or
@@ -1246,6 +1455,15 @@ class FetchOperation : public Operation {
   virtual void notifyQuerySuccess(bool more_results) = 0;
   virtual void notifyFailure(OperationResult result) = 0;
   virtual void notifyOperationCompleted(OperationResult result) = 0;
+  // Invoked when no row is ready to be read, either because the socket would
+  // block or because all rows of the current query were read. The consumer
+  // is allowed to pause the operation here.
+  virtual void notifyRowsExhausted() {}
+  // Whether the operation is paused waiting on its own work rather than on
+  // the consumer, so the timeout stays armed.
+  virtual bool timesOutWhilePaused() const {
+    return false;
+  }
 
   bool cancel_ = false;
 
@@ -1256,6 +1474,9 @@ class FetchOperation : public Operation {
   bool setQueryAttribute(const std::string& key, const std::string& value);
 
   void resumeImpl();
+  // Looks up the projected columns in the current result. If one is missing
+  // the fetch is cancelled and false returned.
+  bool resolveColumnProjection();
   // Checks if the current thread has access to stream, or result data.
   bool isStreamAccessAllowed() const;
   bool isPaused() const;
@@ -1263,16 +1484,16 @@ class FetchOperation : public Operation {
   // Read the response attributes
   RespAttrs readResponseAttributes();
 
-  // Asynchronously kill a currently running query, returns
-  // before the query is killed
-  void killRunningQuery();
-
   // Current query data
   folly::Optional<RowStream> current_row_stream_;
   bool query_executed_ = false;
   bool no_index_used_ = false;
   bool use_checksum_ = false;
   bool was_slow_ = false;
+  bool queries_rendered_ = false;
+  std::vector<std::string> projection_names_;
+  std::vector<size_t> projected_columns_;
+  RowFilter row_filter_;
   // TODO: Rename `executed` to `succeeded`
   int num_queries_executed_ = 0;
   // During a `notify` call, the consumer might want to know the index of the
@@ -1311,6 +1532,7 @@ class MultiQueryStreamOperation : public FetchOperation {
 
   void notifyInitQuery() override;
   void notifyRowsReady() override;
+  void notifyRowsExhausted() override;
   void notifyQuerySuccess(bool more_results) override;
   void notifyFailure(OperationResult result) override;
   void notifyOperationCompleted(OperationResult result) override;
@@ -1446,6 +1668,56 @@ class QueryOperation : public FetchOperation {
     return this;
   }
 
+  // Rows are added to the result, and the RowsFetched callback invoked, once
+  // they fill a RowBlock of this many bytes of values or this many rows,
+  // whichever comes first, instead of once per read from the socket.  The
+  // last block of the query may be smaller.  0, the default, disables the
+  // target.
+  QueryOperation* setTargetRowBlockBytes(size_t bytes) {
+    CHECK_THROW(
+        state() == OperationState::Unstarted, db::OperationStateException);
+    target_block_bytes_ = bytes;
+    return this;
+  }
+
+  QueryOperation* setTargetRowBlockRows(size_t rows) {
+    CHECK_THROW(
+        state() == OperationState::Unstarted, db::OperationStateException);
+    target_block_rows_ = rows;
+    return this;
+  }
+
+  // Spills RowBlocks of the result to a temp file in `spill_directory`
+  // once more than `bytes` of them are in memory, see
+  // QueryResult::setMemoryLimit.  The client's ResultMemoryBudget, if set,
+  // applies as well.  0, the default, disables the per operation limit.
+  QueryOperation* setResultMemoryLimit(
+      size_t bytes,
+      std::string spill_directory = "") {
+    CHECK_THROW(
+        state() == OperationState::Unstarted, db::OperationStateException);
+    result_memory_limit_ = bytes;
+    spill_directory_ = std::move(spill_directory);
+    return this;
+  }
+
+  // Fails the operation, closing the connection like a cancel, once the
+  // result has more than this many rows or bytes of values.  0, the
+  // default, disables the cap.
+  QueryOperation* setMaxResultRows(uint64_t rows) {
+    CHECK_THROW(
+        state() == OperationState::Unstarted, db::OperationStateException);
+    max_result_rows_ = rows;
+    return this;
+  }
+
+  QueryOperation* setMaxResultBytes(uint64_t bytes) {
+    CHECK_THROW(
+        state() == OperationState::Unstarted, db::OperationStateException);
+    max_result_bytes_ = bytes;
+    return this;
+  }
+
   db::OperationType getOperationType() const override {
     return db::OperationType::Query;
   }
@@ -1458,8 +1730,45 @@ class QueryOperation : public FetchOperation {
   void notifyOperationCompleted(OperationResult result) override;
 
  private:
+  bool reachedTargetBlockSize(size_t rows, size_t bytes) const;
+  // Adds pending_block_ to the result.
+  void flushPendingBlock();
+  // Copies the rows of the stream to staged_rows_ for the row conversion
+  // executor.
+  void stageRowsForConversion();
+  // Hands staged_rows_ to the row conversion executor.
+  void convertStagedRows();
+  // Called on the client thread with each block built by the executor.
+  void rowBlockConverted(RowBlock&& row_block);
+  // Called on the executor when a converted block couldn't be handed to
+  // the client thread; fails the operation.
+  void conversionHandOffFailed();
+  bool timesOutWhilePaused() const override {
+    return waiting_for_conversions_;
+  }
+  // Fails the operation if the rows fetched so far are over the caps.
+  void checkResultCaps();
+
   QueryCallback buffered_query_callback_;
   std::unique_ptr<QueryResult> query_result_;
+  size_t target_block_bytes_ = 0;
+  size_t target_block_rows_ = 0;
+  // Rows not added to the result yet because of the target block size.
+  std::optional<RowBlock> pending_block_;
+  size_t pending_block_bytes_ = 0;
+  StreamedRowBatch staged_rows_;
+  // Runs conversions in the order their rows arrived.
+  folly::Executor::KeepAlive<folly::SerialExecutor> conversion_executor_;
+  size_t pending_conversions_ = 0;
+  // Paused in notifyQuerySuccess until pending_conversions_ drops to 0.
+  bool waiting_for_conversions_ = false;
+  size_t result_memory_limit_ = 0;
+  std::string spill_directory_;
+  uint64_t max_result_rows_ = 0;
+  uint64_t max_result_bytes_ = 0;
+  // Rows and bytes of values kept from the stream, counted against the caps.
+  uint64_t fetched_rows_ = 0;
+  uint64_t fetched_bytes_ = 0;
   friend class Connection;
 };
 
@@ -1555,6 +1864,169 @@ class MultiQueryOperation : public FetchOperation {
   friend class Connection;
 };
 
+// An operation running a single query as a server side prepared statement
+// (COM_STMT_PREPARE/COM_STMT_EXECUTE) instead of sending its text. The server
+// parses the statement once per connection, and values are bound straight from
+// the QueryArgument in binary form, without rendering or escaping them.
+//
+// The format may only use value codes (%s, %d, %u, %f and %m), which become
+// `?` placeholders. Statements are kept in the connection's LRU cache, keyed by
+// that text, so following queries with the same format only execute it.
+//
+// Rows are buffered or passed to the callback as with QueryOperation.
+//
+// Constructed via Connection::beginPreparedQuery.
+class PreparedQueryOperation : public Operation {
+ public:
+  ~PreparedQueryOperation() override;
+
+  void setCallback(PreparedQueryCallback cb) {
+    buffered_query_callback_ = std::move(cb);
+  }
+
+  // Steal all rows.  Only valid if there is no callback.  Inefficient
+  // for large result sets.
+  QueryResult&& stealQueryResult() {
+    CHECK_THROW(ok(), db::OperationStateException);
+    return std::move(*query_result_);
+  }
+
+  const QueryResult& queryResult() const {
+    CHECK_THROW(ok(), db::OperationStateException);
+    return *query_result_;
+  }
+
+  const Query& getQuery() const {
+    return query_;
+  }
+
+  // The statement as sent to MySQL for preparing.
+  const folly::fbstring& getExecutedStatement() const {
+    CHECK_THROW(
+        state_ != OperationState::Unstarted, db::OperationStateException);
+    return statement_;
+  }
+
+  // Whether the statement was found in the connection's cache, so it only
+  // had to be executed.
+  bool statementCacheHit() const {
+    CHECK_THROW(
+        state_ != OperationState::Unstarted, db::OperationStateException);
+    return statement_cache_hit_;
+  }
+
+  // Last insert id (aka mysql_stmt_insert_id).
+  uint64_t lastInsertId() const {
+    return query_result_->lastInsertId();
+  }
+
+  // Number of rows affected (aka mysql_stmt_affected_rows).
+  uint64_t numRowsAffected() const {
+    return query_result_->numRowsAffected();
+  }
+
+  uint64_t resultSize() const {
+    CHECK_THROW(
+        state_ != OperationState::Unstarted, db::OperationStateException);
+    return total_result_size_;
+  }
+
+  // Don't call this; it's public strictly for Connection to be able
+  // to call make_shared.
+  PreparedQueryOperation(ConnectionProxy&& connection, Query&& query);
+
+  // Overriding to narrow the return type
+  PreparedQueryOperation* setTimeout(Duration timeout) {
+    Operation::setTimeout(timeout);
+    return this;
+  }
+
+  PreparedQueryOperation* setUserData(folly::dynamic val) {
+    Operation::setUserData(std::move(val));
+    return this;
+  }
+
+  void mustSucceed() override;
+
+  db::OperationType getOperationType() const override {
+    return db::OperationType::PreparedQuery;
+  }
+
+ protected:
+  PreparedQueryOperation* specializedRun() override;
+  void socketActionable() override;
+  void specializedTimeoutTriggered() override;
+  void specializedCompleteOperation() override;
+
+ private:
+  enum class StatementAction {
+    Prepare,
+    Bind,
+    Execute,
+    InitFetch,
+    Fetch,
+    Complete
+  };
+
+  // Value of a bound parameter that MYSQL_BIND can't point to directly.
+  union ParamValue {
+    int64_t int_value;
+    double double_value;
+  };
+
+  // Buffers receiving one column of the current row.
+  struct ResultColumn {
+    FieldStorage storage = FieldStorage::Text;
+    // Used by Text columns.
+    std::string buffer;
+    // Used by the other columns.
+    union {
+      int64_t int_value;
+      double double_value;
+      MYSQL_TIME time_value;
+    } native;
+    unsigned long length = 0;
+    bool is_null = false;
+    bool error = false;
+  };
+
+  void specializedRunImpl();
+
+  // Takes the statement from the connection's cache, or starts preparing it.
+  // Returns false if the statement couldn't be created.
+  bool lookupStatement();
+  // Binds the query parameters to the statement. Returns false on errors.
+  bool bindParams();
+  void bindResult(MYSQL_FIELD* fields, size_t num_fields);
+  // Refetches columns that didn't fit their buffer. Returns false on errors.
+  bool fetchTruncatedColumns();
+  void appendCurrentRow(RowBlock* block);
+  void notifyRowsReady(RowBlock&& block);
+  void snapshotStatementErrors();
+
+  Query query_;
+  folly::fbstring statement_;
+  std::vector<char> param_codes_;
+
+  // Owned by the connection's statement cache.
+  MYSQL_STMT* stmt_ = nullptr;
+  bool statement_cache_hit_ = false;
+  StatementAction action_ = StatementAction::Prepare;
+
+  std::vector<MYSQL_BIND> param_binds_;
+  std::vector<ParamValue> param_values_;
+  std::vector<MYSQL_BIND> result_binds_;
+  std::vector<ResultColumn> result_columns_;
+  std::vector<FieldStorage> field_storage_;
+
+  PreparedQueryCallback buffered_query_callback_;
+  std::unique_ptr<QueryResult> query_result_;
+  uint64_t rows_received_ = 0;
+  uint64_t total_result_size_ = 0;
+
+  friend class Connection;
+};
+
 // SpecialOperation means operations like COM_RESET_CONNECTION,
 // COM_CHANGE_USER, etc.
 class SpecialOperation : public Operation {
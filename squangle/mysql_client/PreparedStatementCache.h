@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/container/EvictingCacheMap.h>
+#include <mysql.h> // @manual
+
+#include <memory>
+#include <string>
+
+namespace facebook::common::mysql_client {
+
+struct MysqlStmtDeleter {
+  void operator()(MYSQL_STMT* stmt) const {
+    mysql_stmt_close(stmt);
+  }
+};
+using MysqlStmtUniquePtr = std::unique_ptr<MYSQL_STMT, MysqlStmtDeleter>;
+
+// LRU cache of server side prepared statements of a single connection, keyed
+// by the statement text they were prepared from. Evicted statements are closed
+// right away, which sends COM_STMT_CLOSE if the connection is still open: one
+// small blocking write on the loop thread per eviction, with no reply to wait
+// for. Statements closed after mysql_close() only free client memory.
+//
+// The cache belongs to the MysqlConnectionHolder, so it follows the MYSQL
+// handle when the connection is recycled through a pool. Statements are
+// dropped on the server by COM_RESET_CONNECTION and COM_CHANGE_USER, and the
+// cache must be cleared after either.
+//
+// Only accessed from the thread running operations on the connection.
+class PreparedStatementCache {
+ public:
+  explicit PreparedStatementCache(size_t max_size) : statements_(max_size) {}
+
+  // Returns the statement prepared from `statement` and marks it as the most
+  // recently used, or nullptr.
+  MYSQL_STMT* find(folly::StringPiece statement) {
+    auto it = statements_.find(statement.str());
+    return it == statements_.end() ? nullptr : it->second.get();
+  }
+
+  // Takes ownership of a statement for `statement`, closing the least recently
+  // used one if the cache is full.
+  MYSQL_STMT* insert(folly::StringPiece statement, MysqlStmtUniquePtr stmt) {
+    auto* ret = stmt.get();
+    statements_.set(statement.str(), std::move(stmt));
+    return ret;
+  }
+
+  // Closes the statement for `statement`, e.g. after the server reported it as
+  // unknown.
+  void erase(folly::StringPiece statement) {
+    statements_.erase(statement.str());
+  }
+
+  void clear() {
+    statements_.clear();
+  }
+
+  size_t size() const {
+    return statements_.size();
+  }
+
+  size_t maxSize() const {
+    return statements_.getMaxSize();
+  }
+
+ private:
+  folly::EvictingCacheMap<std::string, MysqlStmtUniquePtr> statements_;
+};
+
+} // namespace facebook::common::mysql_client
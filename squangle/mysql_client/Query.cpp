@@ -7,6 +7,7 @@
  */
 
 #include "squangle/mysql_client/Query.h"
+#include "squangle/mysql_client/EscapeString.h"
 #include <folly/Format.h>
 #include <folly/String.h>
 
@@ -232,6 +233,14 @@ Query::Query(
       unsafe_query_(false),
       params_(std::move(params)) {}
 
+Query::Query(
+    const QueryTemplate& query_template,
+    std::vector<QueryArgument> params)
+    : query_text_(QueryText::makeShallow(query_template.getFormat())),
+      unsafe_query_(false),
+      params_(std::move(params)),
+      program_(query_template.program_) {}
+
 Query::~Query() {}
 
 namespace {
@@ -315,6 +324,56 @@ advance(const folly::StringPiece s, size_t* offset, size_t num) {
       s.data() + *offset - num + 1, s.data() + *offset + 1);
 }
 
+// Walk a format string, calling on_literal with each piece of literal text
+// and on_code with the offset, code and type (second character of %=x and
+// %Lx) of each % code. Raises an exception on malformed formats.
+template <typename LiteralFunc, typename CodeFunc>
+void walkQueryFormat(
+    const folly::StringPiece s,
+    LiteralFunc&& on_literal,
+    CodeFunc&& on_code) {
+  auto offset = s.find_first_of(";'\"`");
+  if (offset != folly::StringPiece::npos) {
+    parseError(s, offset, "Saw dangerous characters in SQL query");
+  }
+
+  size_t literal_start = 0;
+  size_t idx;
+  for (idx = 0; idx < s.size(); ++idx) {
+    if (s[idx] != '%') {
+      continue;
+    }
+    on_literal(s.subpiece(literal_start, idx - literal_start));
+    if (++idx == s.size()) {
+      parseError(s, idx, "string ended with unfinished % code");
+    }
+
+    char c = s[idx];
+    if (c == '%') {
+      // The second % starts the next literal.
+      literal_start = idx;
+      continue;
+    }
+
+    char type = 0;
+    if (c == '=') {
+      type = advance(s, &idx, 1)[0];
+      if (type != 'd' && type != 's' && type != 'f' && type != 'u' &&
+          type != 'm') {
+        parseError(s, idx, "expected %=d, %=f, %=s, %=u, or %=m");
+      }
+    } else if (c == 'L') {
+      type = advance(s, &idx, 1)[0];
+    } else if (folly::StringPiece("dsfumKTCVUWQ").find(c) ==
+               folly::StringPiece::npos) {
+      parseError(s, idx, "unknown % code");
+    }
+    on_code(idx, c, type);
+    literal_start = idx + 1;
+  }
+  on_literal(s.subpiece(literal_start));
+}
+
 // Escape a string (or copy it through unmodified if no connection is
 // available).
 void appendEscapedString(
@@ -328,17 +387,33 @@ void appendEscapedString(
     return;
   }
 
-  size_t old_size = dest->size();
-  dest->resize(old_size + 2 * value.size() + 1);
-  size_t actual_value_size = mysql_real_escape_string(
-      connection, &(*dest)[old_size], value.data(), value.size());
-  dest->resize(old_size + actual_value_size);
+  appendEscaped(dest, value, connection);
 }
 
 } // namespace
 
+QueryTemplate::QueryTemplate(folly::StringPiece format) {
+  auto program = std::make_shared<Program>();
+  program->format = format.to<folly::fbstring>();
+  walkQueryFormat(
+      folly::StringPiece(program->format),
+      [&](folly::StringPiece literal) {
+        if (!literal.empty()) {
+          program->tokens.push_back(Token{literal, 0, 0, 0});
+        }
+      },
+      [&](size_t idx, char code, char type) {
+        program->tokens.push_back(Token{{}, code, type, idx});
+        ++program->num_params;
+      });
+  program_ = std::move(program);
+}
+
 void Query::append(const Query& query2) {
   query_text_ += query2.query_text_;
+  // Appending copied the text out of the program's format, which may be
+  // all that kept it alive, so the program can only go now.
+  program_.reset();
   for (const auto& param2 : query2.params_) {
     params_.push_back(param2);
   }
@@ -346,6 +421,7 @@ void Query::append(const Query& query2) {
 
 void Query::append(Query&& query2) {
   query_text_ += query2.query_text_;
+  program_.reset();
   for (const auto& param2 : query2.params_) {
     params_.push_back(std::move(param2));
   }
@@ -366,7 +442,7 @@ void Query::appendValue(
     if (type != 's' && type != 'v' && type != 'm') {
       formatStringParseError(querySp, offset, type, "string");
     }
-    auto value = d.asString();
+    const auto& value = d.getString();
     s->reserve(s->size() + value.size() + 4);
     s->push_back('"');
     appendEscapedString(s, value, connection);
@@ -468,6 +544,113 @@ folly::fbstring Query::render(MYSQL* conn) const {
   return render(conn, params_);
 }
 
+void Query::appendCode(
+    folly::fbstring* ret,
+    size_t idx,
+    char c,
+    char type,
+    const QueryArgument& param,
+    MYSQL* conn) const {
+  auto querySp = query_text_.getQuery();
+
+  if (c == 'd' || c == 's' || c == 'f' || c == 'u') {
+    appendValue(ret, idx, c, param, conn);
+  } else if (c == 'm') {
+    if (!(param.isString() || param.isInt() || param.isDouble() ||
+          param.isBool() || param.isNull())) {
+      parseError(querySp, idx, "%m expects int/float/string/bool");
+    }
+    appendValue(ret, idx, c, param, conn);
+  } else if (c == 'K') {
+    ret->append("/*");
+    appendComment(ret, param);
+    ret->append("*/");
+  } else if (c == 'T' || c == 'C') {
+    appendColumnTableName(ret, param);
+  } else if (c == '=') {
+    if (param.isNull()) {
+      ret->append(" IS NULL");
+    } else {
+      ret->append(" = ");
+      appendValue(ret, idx, type, param, conn);
+    }
+  } else if (c == 'V') {
+    if (param.isQuery()) {
+      parseError(querySp, idx, "%V doesn't allow subquery");
+    }
+    size_t col_idx;
+    size_t row_len = 0;
+    bool first_row = true;
+    bool first_in_row = true;
+    for (const auto& row : param.getList()) {
+      first_in_row = true;
+      col_idx = 0;
+      if (!first_row) {
+        ret->append(", ");
+      }
+      ret->append("(");
+      for (const auto& col : row.getList()) {
+        if (!first_in_row) {
+          ret->append(", ");
+        }
+        appendValue(ret, idx, 'v', col, conn);
+        col_idx++;
+        first_in_row = false;
+        if (first_row) {
+          row_len++;
+        }
+      }
+      ret->append(")");
+      if (first_row) {
+        first_row = false;
+      } else if (col_idx != row_len) {
+        parseError(
+            querySp,
+            idx,
+            "not all rows provided for %V formatter are the same size");
+      }
+    }
+  } else if (c == 'L') {
+    if (type == 'O' || type == 'A') {
+      ret->append("(");
+      const char* sep = (type == 'O') ? " OR " : " AND ";
+      appendValueClauses(ret, &idx, sep, param, conn);
+      ret->append(")");
+    } else {
+      if (!param.isList()) {
+        parseError(querySp, idx, "expected array for %L formatter");
+      }
+
+      bool first_param = true;
+      for (const auto& val : param.getList()) {
+        if (!first_param) {
+          ret->append(", ");
+        }
+        first_param = false;
+        if (type == 'C') {
+          appendColumnTableName(ret, val);
+        } else {
+          appendValue(ret, idx, type, val, conn);
+        }
+      }
+    }
+  } else if (c == 'U' || c == 'W') {
+    if (c == 'W') {
+      appendValueClauses(ret, &idx, " AND ", param, conn);
+    } else {
+      appendValueClauses(ret, &idx, ", ", param, conn);
+    }
+  } else if (c == 'Q') {
+    if (param.isQuery()) {
+      ret->append(param.getQuery().render(conn));
+    } else {
+      ret->append((param).asString());
+    }
+  } else {
+    parseError(querySp, idx, "unknown % code");
+  }
+}
+
 folly::fbstring Query::render(
     MYSQL* conn,
     const std::vector<QueryArgument>& params) const {
@@ -477,150 +660,101 @@ folly::fbstring Query::render(
     return querySp.to<folly::fbstring>();
   }
 
-  auto offset = querySp.find_first_of(";'\"`");
-  if (offset != folly::StringPiece::npos) {
-    parseError(querySp, offset, "Saw dangerous characters in SQL query");
-  }
-
   folly::fbstring ret;
   ret.reserve(querySp.size() + 8 * params.size());
 
   auto current_param = params.begin();
-  bool after_percent = false;
-  size_t idx;
-  // Walk our string, watching for % values.
-  for (idx = 0; idx < querySp.size(); ++idx) {
-    char c = querySp[idx];
-    if (!after_percent) {
-      if (c != '%') {
-        ret.push_back(c);
+  auto append_literal = [&](folly::StringPiece literal) {
+    ret.append(literal.data(), literal.size());
+  };
+  auto append_code = [&](size_t idx, char code, char type) {
+    if (current_param == params.end()) {
+      parseError(querySp, idx, "too few parameters for query");
+    }
+    appendCode(&ret, idx, code, type, *current_param++, conn);
+  };
+
+  if (program_) {
+    // The format was already validated and split by the QueryTemplate.
+    for (const auto& token : program_->tokens) {
+      if (token.code == 0) {
+        append_literal(token.literal);
       } else {
-        after_percent = true;
+        append_code(token.offset, token.code, token.type);
       }
-      continue;
     }
+  } else {
+    walkQueryFormat(querySp, append_literal, append_code);
+  }
 
-    after_percent = false;
-    if (c == '%') {
-      ret.push_back('%');
-      continue;
-    }
+  if (current_param != params.end()) {
+    parseError(querySp, 0, "too many parameters specified for query");
+  }
 
-    if (current_param == params.end()) {
+  return ret;
+}
+
+folly::fbstring Query::renderPreparedStatement(
+    std::vector<char>* codes) const {
+  auto querySp = query_text_.getQuery();
+  codes->clear();
+
+  if (unsafe_query_) {
+    return querySp.to<folly::fbstring>();
+  }
+
+  folly::fbstring ret;
+  ret.reserve(querySp.size());
+
+  auto current_param = params_.begin();
+  auto append_literal = [&](folly::StringPiece literal) {
+    ret.append(literal.data(), literal.size());
+  };
+  auto append_code = [&](size_t idx, char code, char /*type*/) {
+    if (current_param == params_.end()) {
       parseError(querySp, idx, "too few parameters for query");
     }
-
     const auto& param = *current_param++;
-    if (c == 'd' || c == 's' || c == 'f' || c == 'u') {
-      appendValue(&ret, idx, c, param, conn);
-    } else if (c == 'm') {
-      if (!(param.isString() || param.isInt() || param.isDouble() ||
-            param.isBool() || param.isNull())) {
-        parseError(querySp, idx, "%m expects int/float/string/bool");
-      }
-      appendValue(&ret, idx, c, param, conn);
-    } else if (c == 'K') {
-      ret.append("/*");
-      appendComment(&ret, param);
-      ret.append("*/");
-    } else if (c == 'T' || c == 'C') {
-      appendColumnTableName(&ret, param);
-    } else if (c == '=') {
-      folly::StringPiece type = advance(querySp, &idx, 1);
-      if (type != "d" && type != "s" && type != "f" && type != "u" &&
-          type != "m") {
-        parseError(querySp, idx, "expected %=d, %=f, %=s, %=u, or %=m");
+    if (folly::StringPiece("dsfum").find(code) == folly::StringPiece::npos) {
+      parseError(querySp, idx, "only value codes can be bound to a statement");
+    }
+    // Same rules as appendValue, except that subqueries can't be bound.
+    if (param.isString()) {
+      if (code != 's' && code != 'm') {
+        formatStringParseError(querySp, idx, code, "string");
       }
-
-      if (param.isNull()) {
-        ret.append(" IS NULL");
-      } else {
-        ret.append(" = ");
-        appendValue(&ret, idx, type[0], param, conn);
+    } else if (param.isBool()) {
+      if (code != 'm') {
+        formatStringParseError(querySp, idx, code, "bool");
       }
-    } else if (c == 'V') {
-      if (param.isQuery()) {
-        parseError(querySp, idx, "%V doesn't allow subquery");
+    } else if (param.isInt()) {
+      if (code != 'd' && code != 'm' && code != 'u') {
+        formatStringParseError(querySp, idx, code, "int");
       }
-      size_t col_idx;
-      size_t row_len = 0;
-      bool first_row = true;
-      bool first_in_row = true;
-      for (const auto& row : param.getList()) {
-        first_in_row = true;
-        col_idx = 0;
-        if (!first_row) {
-          ret.append(", ");
-        }
-        ret.append("(");
-        for (const auto& col : row.getList()) {
-          if (!first_in_row) {
-            ret.append(", ");
-          }
-          appendValue(&ret, idx, 'v', col, conn);
-          col_idx++;
-          first_in_row = false;
-          if (first_row) {
-            row_len++;
-          }
-        }
-        ret.append(")");
-        if (first_row) {
-          first_row = false;
-        } else if (col_idx != row_len) {
-          parseError(
-              querySp,
-              idx,
-              "not all rows provided for %V formatter are the same size");
-        }
+    } else if (param.isDouble()) {
+      if (code != 'f' && code != 'm') {
+        formatStringParseError(querySp, idx, code, "double");
       }
-    } else if (c == 'L') {
-      folly::StringPiece type = advance(querySp, &idx, 1);
-      if (type == "O" || type == "A") {
-        ret.append("(");
-        const char* sep = (type == "O") ? " OR " : " AND ";
-        appendValueClauses(&ret, &idx, sep, param, conn);
-        ret.append(")");
-      } else {
-        if (!param.isList()) {
-          parseError(querySp, idx, "expected array for %L formatter");
-        }
-
-        bool first_param = true;
-        for (const auto& val : param.getList()) {
-          if (!first_param) {
-            ret.append(", ");
-          }
-          first_param = false;
-          if (type == "C") {
-            appendColumnTableName(&ret, val);
-          } else {
-            appendValue(&ret, idx, type[0], val, conn);
-          }
-        }
-      }
-    } else if (c == 'U' || c == 'W') {
-      if (c == 'W') {
-        appendValueClauses(&ret, &idx, " AND ", param, conn);
-      } else {
-        appendValueClauses(&ret, &idx, ", ", param, conn);
-      }
-    } else if (c == 'Q') {
-      if (param.isQuery()) {
-        ret.append(param.getQuery().render(conn));
+    } else if (!param.isNull()) {
+      formatStringParseError(querySp, idx, code, param.typeName());
+    }
+    ret.push_back('?');
+    codes->push_back(code);
+  };
+
+  if (program_) {
+    for (const auto& token : program_->tokens) {
+      if (token.code == 0) {
+        append_literal(token.literal);
       } else {
-        ret.append((param).asString());
+        append_code(token.offset, token.code, token.type);
       }
-    } else {
-      parseError(querySp, idx, "unknown % code");
     }
+  } else {
+    walkQueryFormat(querySp, append_literal, append_code);
   }
 
-  if (after_percent) {
-    parseError(querySp, idx, "string ended with unfinished % code");
-  }
-
-  if (current_param != params.end()) {
+  if (current_param != params_.end()) {
     parseError(querySp, 0, "too many parameters specified for query");
   }
 
@@ -68,6 +68,12 @@
 // %K - an SQL comment.  Will put the /* and */ for you.
 // %% - literal % character.
 //
+// Formats rendered many times can be parsed once with a QueryTemplate, so
+// rendering doesn't need to re-scan and re-validate the format string:
+//
+// static const QueryTemplate kSelect("SELECT %LC FROM %T WHERE id = %d");
+// Query q(kSelect, columns, "assoc_info", 17);
+//
 // For more details, check out queryfx in the www codebase.
 
 #ifndef COMMON_ASYNC_MYSQL_QUERY_H
@@ -84,9 +90,11 @@
 
 #include <mysql.h>
 
+#include <memory>
 #include <optional>
 #include <string>
 #include <tuple>
+#include <vector>
 
 #include "squangle/base/Base.h"
 
@@ -99,8 +107,49 @@ using AliasedQualifiedColumn =
     std::tuple<folly::fbstring, folly::fbstring, folly::fbstring>;
 using QueryAttributes = AttributeMap;
 
+class Query;
 class QueryArgument;
 
+// A query format string parsed once into literal text and `%` codes. Queries
+// constructed from it render by walking the parsed codes. The format is
+// validated on construction, which throws std::invalid_argument on the same
+// errors Query::render would raise. Cheap to copy.
+class QueryTemplate {
+ public:
+  explicit QueryTemplate(folly::StringPiece format);
+
+  folly::StringPiece getFormat() const {
+    return program_->format;
+  }
+
+  // Number of parameters the format expects.
+  size_t numParams() const {
+    return program_->num_params;
+  }
+
+ private:
+  friend class Query;
+
+  // Either literal text (`code` is 0) or a `%` code. `type` holds the second
+  // character of two character codes such as %=d or %Ls.
+  struct Token {
+    folly::StringPiece literal;
+    char code;
+    char type;
+    // Position of the code in the format, for error messages.
+    size_t offset;
+  };
+
+  struct Program {
+    folly::fbstring format;
+    // Literals point into `format`.
+    std::vector<Token> tokens;
+    size_t num_params = 0;
+  };
+
+  std::shared_ptr<const Program> program_;
+};
+
 /*
  * This class will be responsible of passing various per query options.
  * For the time being we only have attributes but class will be extended
@@ -145,6 +194,12 @@ class Query {
   /* implicit */ Query(const folly::StringPiece query_text, Args&&... args);
   Query(const folly::StringPiece query_text, std::vector<QueryArgument> params);
 
+  // Same as above but with a pre-parsed format.  The Query shares the
+  // template's parsed program, so the template may be destroyed first.
+  template <typename... Args>
+  /* implicit */ Query(const QueryTemplate& query_template, Args&&... args);
+  Query(const QueryTemplate& query_template, std::vector<QueryArgument> params);
+
   void append(const Query& query2);
   void append(Query&& query2);
 
@@ -216,10 +271,20 @@ class Query {
   folly::fbstring renderInsecure(
       const std::vector<QueryArgument>& params) const;
 
+  // Renders the query as the text of a server side prepared statement. Value
+  // codes (%s, %d, %u, %f and %m) become `?` placeholders, to be bound to the
+  // parameters in order; `codes` receives the code of each one. Other codes
+  // and parameters that don't match their code throw std::invalid_argument.
+  folly::fbstring renderPreparedStatement(std::vector<char>* codes) const;
+
   folly::StringPiece getQueryFormat() const {
     return query_text_.getQuery();
   }
 
+  const std::vector<QueryArgument>& getParams() const {
+    return params_;
+  }
+
  private:
   // QueryText is a container for query stmt used by the Query (see below).
   // Its a union like structure that supports managing either a shallow copy
@@ -348,6 +413,15 @@ class Query {
       const QueryArgument& param,
       MYSQL* connection) const;
 
+  // append the rendering of the % code found at offset idx
+  void appendCode(
+      folly::fbstring* ret,
+      size_t idx,
+      char code,
+      char type,
+      const QueryArgument& param,
+      MYSQL* connection) const;
+
   template <typename Arg, typename... Args>
   void unpack(Arg&& arg, Args&&... args);
   void unpack() {}
@@ -355,6 +429,9 @@ class Query {
   QueryText query_text_;
   bool unsafe_query_ = false;
   std::vector<QueryArgument> params_{};
+  // Set when constructed from a QueryTemplate, which also owns the text of
+  // `query_text_`.
+  std::shared_ptr<const QueryTemplate::Program> program_;
 };
 
 // Wraps many queries and holds a buffer that contains the rendered multi query
@@ -549,6 +626,16 @@ Query::Query(const folly::StringPiece query_text, Args&&... args)
   params_.reserve(sizeof...(args));
   unpack(std::forward<Args>(args)...);
 }
+template <typename... Args>
+Query::Query(const QueryTemplate& query_template, Args&&... args)
+    : query_text_(QueryText::makeShallow(query_template.getFormat())),
+      unsafe_query_(false),
+      params_(),
+      program_(query_template.program_) {
+  params_.reserve(sizeof...(args));
+  unpack(std::forward<Args>(args)...);
+}
+
 template <typename Arg, typename... Args>
 void Query::unpack(Arg&& arg, Args&&... args /* lol */) {
   using V = folly::remove_cvref_t<Arg>;
@@ -274,7 +274,100 @@ BENCHMARK(createQueryObject) {
   }
 }
 
+constexpr folly::StringPiece kSelectFormat =
+    "SELECT * FROM %T WHERE column3 = %d AND column5 = %s";
+constexpr folly::StringPiece kSelectWhereFormat =
+    "SELECT %LC FROM %T WHERE %W AND %C IN (%Ld)";
+constexpr folly::StringPiece kUpdateFormat =
+    "UPDATE %T SET %U WHERE id = %d %K";
+constexpr folly::StringPiece kInsertFormat =
+    "INSERT INTO %T (%LC) VALUES %V";
+
+const QueryTemplate& selectTemplate() {
+  static const QueryTemplate kTemplate(kSelectFormat);
+  return kTemplate;
+}
+
+const QueryTemplate& selectWhereTemplate() {
+  static const QueryTemplate kTemplate(kSelectWhereFormat);
+  return kTemplate;
+}
+
+const QueryTemplate& updateTemplate() {
+  static const QueryTemplate kTemplate(kUpdateFormat);
+  return kTemplate;
+}
+
+const QueryTemplate& insertTemplate() {
+  static const QueryTemplate kTemplate(kInsertFormat);
+  return kTemplate;
+}
+
+// Renders the same queries either from the format string or from a
+// QueryTemplate, depending on what `format` maps to.
+template <typename Format>
+void renderQueries(int count, Format&& format) {
+  testArg columns = {"col1", "col2", "col3"};
+  testArg ids = {1, 2, 3, 4, 5, 6, 7, 8};
+  testArg rows = {
+      testArg{1, "foo", 0.2}, testArg{2, "bar", 0.4}, testArg{3, "baz", 0.8}};
+  for (int i = 0; i < count; ++i) {
+    QUERY((format(kSelectFormat, selectTemplate()), "table1", 14, "value"));
+    QUERY(
+        (format(kSelectWhereFormat, selectWhereTemplate()),
+         columns,
+         "table1",
+         testObject("column3", 17)("column5", "99"),
+         "column6",
+         ids));
+    QUERY(
+        (format(kUpdateFormat, updateTemplate()),
+         "table2",
+         testObject("column1", "red")("column2", "small"),
+         7,
+         "my comment"));
+    QUERY((format(kInsertFormat, insertTemplate()), "table1", columns, rows));
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(renderQueryFromFormat) {
+  renderQueries(
+      kCount, [](folly::StringPiece fmt, const QueryTemplate&) { return fmt; });
+}
+
+BENCHMARK_RELATIVE(renderQueryFromTemplate) {
+  renderQueries(
+      kCount,
+      [](folly::StringPiece, const QueryTemplate& tmpl)
+          -> const QueryTemplate& { return tmpl; });
+}
+
+void checkTemplateRendering() {
+  std::vector<folly::StringPiece> formats = {
+      kSelectFormat, kSelectWhereFormat, kUpdateFormat, kInsertFormat};
+  std::vector<std::vector<QueryArgument>> params = {
+      {"table1", 14, "value"},
+      {testArg{"col1", "col2"},
+       "table1",
+       testObject("column3", 17)("column5", nullptr),
+       "column6",
+       testArg{1, 2, 3}},
+      {"table2", testObject("column1", "red"), 7, "my /* magic */ comment"},
+      {"table1",
+       testArg{"a", "b"},
+       testArg{testArg{1, "foo"}, testArg{2, nullptr}}}};
+  for (size_t i = 0; i < formats.size(); ++i) {
+    CHECK_EQ(
+        Query(formats[i], params[i]).renderInsecure(),
+        Query(QueryTemplate(formats[i]), params[i]).renderInsecure());
+  }
+}
+
 int main(int /*argc*/, char** /*argv*/) {
+  checkTemplateRendering();
+
   int keys_count = 1000;
   for (int i = 0; i < keys_count; ++i) {
     keys.push_back(
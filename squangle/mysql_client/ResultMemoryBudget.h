@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace facebook::common::mysql_client {
+
+// Bytes of RowBlocks that the QueryResults of a client may keep in memory
+// together, see MysqlClientBase::setResultMemoryBudget.  Results charge
+// their blocks as they are added and release them when the blocks spill
+// or the result is destroyed; while the budget is exceeded, results spill
+// their older blocks to temp files in `spill_directory`.
+//
+// Thread safe, since results are usually destroyed outside the client thread.
+class ResultMemoryBudget {
+ public:
+  // An empty `spill_directory` uses the system's temp directory.
+  explicit ResultMemoryBudget(
+      size_t max_bytes,
+      std::string spill_directory = "")
+      : max_bytes_(max_bytes), spill_directory_(std::move(spill_directory)) {}
+
+  size_t maxBytes() const {
+    return max_bytes_;
+  }
+
+  size_t usedBytes() const {
+    return used_bytes_.load(std::memory_order_relaxed);
+  }
+
+  bool exceeded() const {
+    return usedBytes() > max_bytes_;
+  }
+
+  const std::string& spillDirectory() const {
+    return spill_directory_;
+  }
+
+  void charge(size_t bytes) {
+    used_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  void release(size_t bytes) {
+    used_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  ResultMemoryBudget(const ResultMemoryBudget&) = delete;
+  ResultMemoryBudget& operator=(const ResultMemoryBudget&) = delete;
+
+ private:
+  const size_t max_bytes_;
+  const std::string spill_directory_;
+  std::atomic<size_t> used_bytes_{0};
+};
+
+} // namespace facebook::common::mysql_client
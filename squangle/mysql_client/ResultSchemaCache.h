@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/container/EvictingCacheMap.h>
+#include <folly/hash/Hash.h>
+
+#include <memory>
+#include <vector>
+
+#include "squangle/mysql_client/Row.h"
+
+namespace facebook::common::mysql_client {
+
+// LRU cache of the RowFields of the results seen on a single connection,
+// keyed by a hash of the field names, table names, types and flags. Results
+// with the same schema share one immutable RowFields instead of copying the
+// metadata of every query. Hits are compared field by field, so a hash
+// collision or a changed table never returns the wrong schema.
+//
+// Only accessed from the thread running operations on the connection.
+class ResultSchemaCache {
+ public:
+  explicit ResultSchemaCache(size_t max_size) : schemas_(max_size) {}
+
+  // Returns RowFields equal to fields.makeBufferedFields(columns).
+  std::shared_ptr<RowFields> getRowFields(
+      const EphemeralRowFields& fields,
+      const std::vector<size_t>* columns = nullptr) {
+    auto num_fields = columns ? columns->size() : fields.numFields();
+    if (num_fields == 0) {
+      return nullptr;
+    }
+    auto hash = hashSchema(fields, columns);
+    auto it = schemas_.find(hash);
+    if (it != schemas_.end() && sameSchema(*it->second, fields, columns)) {
+      ++hits_;
+      return it->second;
+    }
+    ++misses_;
+    auto row_fields = fields.makeBufferedFields(columns);
+    schemas_.set(hash, row_fields);
+    return row_fields;
+  }
+
+  void clear() {
+    schemas_.clear();
+  }
+
+  size_t size() const {
+    return schemas_.size();
+  }
+
+  uint64_t hits() const {
+    return hits_;
+  }
+
+  uint64_t misses() const {
+    return misses_;
+  }
+
+ private:
+  // Projected schemas are keyed by the fields they keep, so they can be
+  // shared with results that only had those fields.
+  static uint64_t hashSchema(
+      const EphemeralRowFields& fields,
+      const std::vector<size_t>* columns) {
+    size_t num_fields = columns ? columns->size() : fields.numFields();
+    uint64_t hash = num_fields;
+    for (size_t n = 0; n < num_fields; ++n) {
+      auto i = columns ? (*columns)[n] : n;
+      hash = folly::hash::hash_combine(
+          hash,
+          fields.fieldName(i),
+          fields.tableName(i),
+          static_cast<int>(fields.fieldType(i)),
+          fields.fieldFlags(i),
+          fields.fieldDecimals(i));
+    }
+    return hash;
+  }
+
+  static bool sameSchema(
+      const RowFields& row_fields,
+      const EphemeralRowFields& fields,
+      const std::vector<size_t>* columns) {
+    size_t num_fields = columns ? columns->size() : fields.numFields();
+    if (row_fields.numFields() != num_fields) {
+      return false;
+    }
+    for (size_t n = 0; n < num_fields; ++n) {
+      auto i = columns ? (*columns)[n] : n;
+      if (row_fields.fieldName(n) != fields.fieldName(i) ||
+          row_fields.tableName(n) != fields.tableName(i) ||
+          row_fields.getFieldType(n) != fields.fieldType(i) ||
+          row_fields.getFieldFlags(n) != fields.fieldFlags(i) ||
+          row_fields.getFieldDecimals(n) != fields.fieldDecimals(i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  folly::EvictingCacheMap<uint64_t, std::shared_ptr<RowFields>> schemas_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+} // namespace facebook::common::mysql_client
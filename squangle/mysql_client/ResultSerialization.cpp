@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/Format.h>
+#include <folly/portability/SysUio.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "squangle/mysql_client/ResultSerialization.h"
+
+namespace facebook::common::mysql_client {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x42525153; // "SQRB"
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t total_size;
+  uint64_t num_fields;
+  uint64_t num_blocks;
+  uint64_t names_size;
+  uint64_t num_rows_affected;
+  uint64_t last_insert_id;
+};
+
+struct Field {
+  uint64_t flags;
+  uint32_t type;
+  uint32_t name_offset;
+  uint32_t name_size;
+  uint32_t table_offset;
+  uint32_t table_size;
+  uint8_t storage;
+  uint8_t decimals;
+  uint8_t padding[2];
+};
+
+struct Block {
+  uint64_t num_rows;
+  uint64_t offset;
+  uint64_t size;
+};
+
+static_assert(sizeof(Header) % 8 == 0);
+static_assert(sizeof(Field) % 8 == 0);
+static_assert(sizeof(Block) % 8 == 0);
+
+size_t aligned(size_t size) {
+  return (size + 7) / 8 * 8;
+}
+
+folly::ByteRange asBytes(const void* data, size_t size) {
+  return folly::ByteRange(static_cast<const unsigned char*>(data), size);
+}
+
+// The serialized result as parts pointing into `prefix`, `scratch` and the
+// result's blocks.
+class ResultWriter {
+ public:
+  explicit ResultWriter(const QueryResult& result) {
+    const auto* row_fields = result.getRowFields();
+    const auto& blocks = result.rows();
+    size_t num_fields = row_fields ? row_fields->numFields() : 0;
+    std::vector<FieldStorage> storage;
+    if (!blocks.empty()) {
+      storage = blocks.front().fieldStorage();
+    }
+    for (const auto& block : blocks) {
+      if (block.fieldStorage() != storage) {
+        throw std::invalid_argument(
+            "Blocks of the result store their fields differently");
+      }
+    }
+
+    std::string names;
+    std::vector<Field> fields(num_fields);
+    auto add_name = [&](folly::StringPiece name, uint32_t& offset) {
+      CHECK_LE(names.size(), std::numeric_limits<uint32_t>::max());
+      offset = static_cast<uint32_t>(names.size());
+      names.append(name.data(), name.size());
+      return static_cast<uint32_t>(name.size());
+    };
+    for (size_t i = 0; i < num_fields; ++i) {
+      auto& field = fields[i];
+      std::memset(&field, 0, sizeof(field));
+      field.flags = row_fields->getFieldFlags(i);
+      field.type = row_fields->getFieldType(i);
+      field.name_size = add_name(row_fields->fieldName(i), field.name_offset);
+      field.table_size =
+          add_name(row_fields->tableName(i), field.table_offset);
+      field.storage = static_cast<uint8_t>(
+          storage.empty() ? FieldStorage::Text : storage[i]);
+      field.decimals = static_cast<uint8_t>(row_fields->getFieldDecimals(i));
+    }
+    names.resize(aligned(names.size()));
+
+    // The blocks' parts, and where each block starts.
+    std::vector<Block> block_entries(blocks.size());
+    size_t prefix_size = sizeof(Header) + fields.size() * sizeof(Field) +
+        block_entries.size() * sizeof(Block) + names.size();
+    size_t offset = prefix_size;
+    std::vector<folly::ByteRange> block_parts;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      auto size = blocks[i].appendColumnParts(block_parts, scratch_);
+      block_entries[i] = Block{blocks[i].numRows(), offset, size};
+      offset += size;
+    }
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = kMagic;
+    header.version = kSerializedResultVersion;
+    header.total_size = offset;
+    header.num_fields = num_fields;
+    header.num_blocks = blocks.size();
+    header.names_size = names.size();
+    header.num_rows_affected = result.numRowsAffected();
+    header.last_insert_id = result.lastInsertId();
+
+    prefix_.reserve(prefix_size);
+    prefix_.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    prefix_.append(
+        reinterpret_cast<const char*>(fields.data()),
+        fields.size() * sizeof(Field));
+    prefix_.append(
+        reinterpret_cast<const char*>(block_entries.data()),
+        block_entries.size() * sizeof(Block));
+    prefix_.append(names);
+    DCHECK_EQ(prefix_.size(), prefix_size);
+
+    parts_.push_back(asBytes(prefix_.data(), prefix_.size()));
+    parts_.insert(parts_.end(), block_parts.begin(), block_parts.end());
+    size_ = offset;
+  }
+
+  const std::vector<folly::ByteRange>& parts() const {
+    return parts_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  std::string prefix_;
+  std::deque<std::string> scratch_;
+  std::vector<folly::ByteRange> parts_;
+  size_t size_ = 0;
+};
+
+} // namespace
+
+size_t writeQueryResult(int fd, const QueryResult& result) {
+  ResultWriter writer(result);
+  std::vector<iovec> iov;
+  iov.reserve(writer.parts().size());
+  for (auto part : writer.parts()) {
+    iov.push_back(iovec{const_cast<unsigned char*>(part.data()), part.size()});
+  }
+  // Split only for results with more than IOV_MAX parts.
+  for (size_t i = 0; i < iov.size(); i += IOV_MAX) {
+    int count = std::min<size_t>(iov.size() - i, IOV_MAX);
+    folly::checkUnixError(
+        folly::writevFull(fd, &iov[i], count),
+        "Failed to write query result");
+  }
+  return writer.size();
+}
+
+std::string serializeQueryResult(const QueryResult& result) {
+  ResultWriter writer(result);
+  std::string ret;
+  ret.reserve(writer.size());
+  for (auto part : writer.parts()) {
+    ret.append(reinterpret_cast<const char*>(part.data()), part.size());
+  }
+  return ret;
+}
+
+QueryResult deserializeQueryResult(
+    folly::ByteRange data,
+    std::shared_ptr<const void> owner) {
+  if (reinterpret_cast<uintptr_t>(data.data()) % 8 != 0) {
+    throw std::invalid_argument("Serialized query result isn't aligned");
+  }
+  if (data.size() < sizeof(Header)) {
+    throw std::out_of_range("Serialized query result is truncated");
+  }
+  Header header;
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != kMagic) {
+    throw std::invalid_argument("Not a serialized query result");
+  }
+  if (header.version != kSerializedResultVersion) {
+    throw std::invalid_argument(folly::sformat(
+        "Serialized query result has version {}, expected {}",
+        header.version,
+        kSerializedResultVersion));
+  }
+  if (header.total_size > data.size()) {
+    throw std::out_of_range(folly::sformat(
+        "Serialized query result of {} bytes is truncated to {}",
+        header.total_size,
+        data.size()));
+  }
+  if (header.num_fields > data.size() || header.num_blocks > data.size() ||
+      header.names_size > data.size() ||
+      sizeof(Header) + header.num_fields * sizeof(Field) +
+              header.num_blocks * sizeof(Block) + header.names_size >
+          header.total_size) {
+    throw std::out_of_range("Serialized query result header is corrupt");
+  }
+
+  const auto* fields =
+      reinterpret_cast<const Field*>(data.data() + sizeof(Header));
+  const auto* blocks =
+      reinterpret_cast<const Block*>(fields + header.num_fields);
+  const char* names = reinterpret_cast<const char*>(blocks + header.num_blocks);
+  auto name = [&](uint32_t offset, uint32_t size) {
+    if (uint64_t(offset) + size > header.names_size) {
+      throw std::out_of_range("Serialized field name is out of range");
+    }
+    return std::string(names + offset, size);
+  };
+
+  QueryResult result(0);
+  std::shared_ptr<RowFields> row_fields;
+  std::vector<FieldStorage> storage;
+  if (header.num_fields > 0) {
+    std::vector<std::string> field_names;
+    std::vector<std::string> table_names;
+    std::vector<uint64_t> flags;
+    std::vector<enum_field_types> types;
+    std::vector<uint8_t> decimals;
+    bool all_text = true;
+    for (size_t i = 0; i < header.num_fields; ++i) {
+      const auto& field = fields[i];
+      field_names.push_back(name(field.name_offset, field.name_size));
+      table_names.push_back(name(field.table_offset, field.table_size));
+      flags.push_back(field.flags);
+      types.push_back(static_cast<enum_field_types>(field.type));
+      decimals.push_back(field.decimals);
+      storage.push_back(static_cast<FieldStorage>(field.storage));
+      all_text &= storage.back() == FieldStorage::Text;
+    }
+    if (all_text) {
+      storage.clear();
+    }
+    row_fields = std::make_shared<RowFields>(
+        std::move(field_names),
+        std::move(table_names),
+        std::move(flags),
+        std::move(types),
+        std::move(decimals));
+    result.setRowFields(row_fields);
+  }
+
+  for (size_t i = 0; i < header.num_blocks; ++i) {
+    const auto& block = blocks[i];
+    // Every row takes at least the end of a value per field, and blocks
+    // start aligned like every section.
+    if (!row_fields || block.offset % 8 != 0 ||
+        block.offset > header.total_size ||
+        block.size > header.total_size - block.offset ||
+        block.num_rows > block.size / sizeof(uint32_t)) {
+      throw std::out_of_range("Serialized block is out of range");
+    }
+    result.appendRowBlock(RowBlock::fromColumnParts(
+        row_fields,
+        storage,
+        block.num_rows,
+        data.subpiece(block.offset, block.size),
+        owner));
+  }
+  result.setNumRowsAffected(header.num_rows_affected);
+  result.setLastInsertId(header.last_insert_id);
+  result.setOperationResult(OperationResult::Succeeded);
+  result.setPartial(false);
+  return result;
+}
+
+} // namespace facebook::common::mysql_client
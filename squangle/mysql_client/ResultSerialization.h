@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/Range.h>
+
+#include <memory>
+#include <string>
+
+#include "squangle/mysql_client/DbResult.h"
+
+namespace facebook::common::mysql_client {
+
+// Binary format of a QueryResult, for caching results and handing them to
+// other processes.  A serialized result is, every section 8 byte aligned:
+//
+//   header     magic, version, total size, field and block counts, and the
+//              affected rows and last insert id of the result
+//   fields     type, flags, storage, decimals and name and table name
+//              offsets of every field
+//   blocks     rows, offset and size of every RowBlock
+//   names      the field and table names
+//   block data the values of every block as RowBlock::appendColumnParts
+//              writes them: per field a null bitmap, value ends and values
+//
+// Integers are in host byte order, so results can only be read on hosts
+// of the same endianness.  Reading a result only checks the header and
+// walks the column offsets; its blocks are Mapped RowBlocks pointing into
+// the serialized data, so the data can stay in shared memory or a mapped
+// file.  Values are trusted, only serialize results you'd read yourself.
+//
+// Blocks of a result must all store their fields the same way (see
+// FieldStorage), which is the case for results of the operations.
+
+constexpr uint32_t kSerializedResultVersion = 2;
+
+// Writes the serialized `result` to `fd` with writev, pointing straight
+// into blocks of the Columns or Mapped layout.  Returns the bytes written.
+// Throws std::system_error if the write fails and std::invalid_argument if
+// the blocks store their fields differently.
+size_t writeQueryResult(int fd, const QueryResult& result);
+
+// Same, into a string.
+std::string serializeQueryResult(const QueryResult& result);
+
+// A result over `data`, which must start at an 8 byte aligned address and
+// be kept alive by `owner`.  Throws std::invalid_argument if the data isn't
+// a serialized result of this version, and std::out_of_range if it is
+// truncated.
+QueryResult deserializeQueryResult(
+    folly::ByteRange data,
+    std::shared_ptr<const void> owner);
+
+} // namespace facebook::common::mysql_client
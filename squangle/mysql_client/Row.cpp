@@ -8,38 +8,380 @@
 
 #include "squangle/mysql_client/Row.h"
 
-#include <re2/re2.h>
+#include <folly/lang/Bits.h>
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
+#include <cstring>
 
 namespace facebook {
 namespace common {
 namespace mysql_client {
 
-std::shared_ptr<RowFields> EphemeralRowFields::makeBufferedFields() const {
-  if (num_fields_ == 0) {
+namespace {
+
+// Date and time parts as written by MySQL, before any normalization.
+struct CivilTime {
+  int year = 0;
+  int month = 0;
+  int day = 0;
+  int hour = 0;
+  int minute = 0;
+  int second = 0;
+  int microseconds = 0;
+};
+
+int64_t floorDiv(int64_t value, int64_t divisor) {
+  return value / divisor - (value % divisor < 0 ? 1 : 0);
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date, month in [1, 12].
+int64_t daysFromCivil(int64_t year, int64_t month, int64_t day) {
+  year -= month <= 2;
+  const int64_t era = floorDiv(year, 400);
+  const int64_t yoe = year - era * 400;
+  const int64_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 +
+      day - 1;
+  const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+// Inverse of daysFromCivil.
+void civilFromDays(int64_t days, int* year, int* month, int* day) {
+  days += 719468;
+  const int64_t era = floorDiv(days, 146097);
+  const int64_t doe = days - era * 146097;
+  const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const int64_t mp = (5 * doy + 2) / 153;
+  *day = doy - (153 * mp + 2) / 5 + 1;
+  *month = mp < 10 ? mp + 3 : mp - 9;
+  *year = yoe + era * 400 + (*month <= 2);
+}
+
+// Seconds local time is ahead of UTC during an hour of local time, counted
+// in hours since 1970-01-01 00:00 local. Asks mktime, so DST rules apply,
+// but only once per hour: consecutive timestamps are mostly in the same hour.
+int64_t localUtcOffset(int64_t local_hour) {
+  struct CachedOffset {
+    bool valid = false;
+    int64_t local_hour = 0;
+    int64_t offset = 0;
+  };
+  // A TZ change is only seen once a thread parses a different hour.
+  static thread_local CachedOffset cached;
+  if (cached.valid && cached.local_hour == local_hour) {
+    return cached.offset;
+  }
+
+  auto days = floorDiv(local_hour, 24);
+  int year, month, day;
+  civilFromDays(days, &year, &month, &day);
+  struct tm time_tm = {0};
+  time_tm.tm_isdst = -1;
+  time_tm.tm_year = year - 1900;
+  time_tm.tm_mon = month - 1;
+  time_tm.tm_mday = day;
+  time_tm.tm_hour = local_hour - days * 24;
+  auto t = mktime(&time_tm);
+  if (t == -1) {
+    throw std::range_error("Date values are invalid");
+  }
+  cached = {true, local_hour, local_hour * 3600 - t};
+  return cached.offset;
+}
+
+// Converts local date and time parts the way mktime does with tm_isdst = -1,
+// including normalizing out of range values. Like the tm based conversion
+// parseDateTime used to do, year 0 is taken as 1900 and month 0 as January.
+std::chrono::system_clock::time_point toTimePoint(const CivilTime& civil) {
+  int64_t year = civil.year == 0 ? 1900 : civil.year;
+  int64_t month = civil.month == 0 ? 0 : civil.month - 1;
+  year += floorDiv(month, 12);
+  month = month - floorDiv(month, 12) * 12 + 1;
+
+  int64_t local = (daysFromCivil(year, month, 1) + civil.day - 1) * 86400 +
+      civil.hour * 3600 + civil.minute * 60 + civil.second;
+  int64_t t = local - localUtcOffset(floorDiv(local, 3600));
+  if (t == -1) {
+    throw std::range_error("Date values are invalid");
+  }
+
+  return std::chrono::system_clock::from_time_t(t) +
+      std::chrono::microseconds(civil.microseconds);
+}
+
+bool isDigit(char c) {
+  return static_cast<unsigned char>(c - '0') < 10;
+}
+
+int digitValue(char c) {
+  return c - '0';
+}
+
+// Loads 8 bytes with the first one in the lowest bits.
+uint64_t loadWord(const char* data) {
+  uint64_t word;
+  std::memcpy(&word, data, sizeof(word));
+  return folly::Endian::little(word);
+}
+
+// True if the bytes of `word` selected by `digits` (0xff each) are ASCII
+// digits and the other bytes are those of `separators`.
+bool matchesPattern(uint64_t word, uint64_t digits, uint64_t separators) {
+  if ((word & ~digits) != separators) {
+    return false;
+  }
+  // Separators become '0' so all 8 bytes can be checked at once: a digit is
+  // 0x3X with X + 6 not carrying into the high nibble.
+  word = (word & digits) | (0x3030303030303030 & ~digits);
+  return ((word & 0xF0F0F0F0F0F0F0F0) |
+          (((word + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+      0x3333333333333333;
+}
+
+int byteDigit(uint64_t word, int byte) {
+  return (word >> (8 * byte)) & 0xf;
+}
+
+// Parses the optional ".f{1,6}" ending a time, `data` is right after the
+// seconds.
+bool parseFraction(const char* data, const char* end, int* microseconds) {
+  if (data == end) {
+    return true;
+  }
+  auto digits = end - data - 1;
+  if (*data != '.' || digits < 1 || digits > 6) {
+    return false;
+  }
+  int value = 0;
+  for (auto* p = data + 1; p != end; ++p) {
+    if (!isDigit(*p)) {
+      return false;
+    }
+    value = value * 10 + digitValue(*p);
+  }
+  for (auto i = digits; i < 6; ++i) {
+    value *= 10;
+  }
+  *microseconds = value;
+  return true;
+}
+
+// "YYYY-MM-DD", `data` has at least 10 bytes.
+bool parseDate(const char* data, CivilTime* civil) {
+  auto word = loadWord(data);
+  if (!matchesPattern(word, 0x00FFFF00FFFFFFFF, 0x2D00002D00000000) ||
+      !isDigit(data[8]) || !isDigit(data[9])) {
+    return false;
+  }
+  civil->year = byteDigit(word, 0) * 1000 + byteDigit(word, 1) * 100 +
+      byteDigit(word, 2) * 10 + byteDigit(word, 3);
+  civil->month = byteDigit(word, 5) * 10 + byteDigit(word, 6);
+  civil->day = digitValue(data[8]) * 10 + digitValue(data[9]);
+  return true;
+}
+
+// "YYYY-MM-DD HH:MM:SS[.ffffff]".
+bool parseDateAndTime(folly::StringPiece value, CivilTime* civil) {
+  constexpr size_t kSize = 19;
+  if (value.size() < kSize || !parseDate(value.data(), civil)) {
+    return false;
+  }
+  const char* data = value.data();
+  // "DD HH:MM", the day was checked by parseDate.
+  auto word = loadWord(data + 8);
+  if (!matchesPattern(word, 0xFFFF00FFFF00FFFF, 0x00003A0000200000) ||
+      data[16] != ':' || !isDigit(data[17]) || !isDigit(data[18])) {
+    return false;
+  }
+  civil->hour = byteDigit(word, 3) * 10 + byteDigit(word, 4);
+  civil->minute = byteDigit(word, 6) * 10 + byteDigit(word, 7);
+  civil->second = digitValue(data[17]) * 10 + digitValue(data[18]);
+  return parseFraction(data + kSize, value.end(), &civil->microseconds);
+}
+
+// Value of 8 ASCII digits loaded with loadWord, three multiplications
+// instead of eight.
+uint64_t parseEightDigits(uint64_t word) {
+  word -= 0x3030303030303030;
+  // Pairs of digits, then groups of four, then all eight.
+  word = (word * 10) + (word >> 8);
+  word = (((word & 0x000000FF000000FF) * 0x000F424000000064) +
+          (((word >> 16) & 0x000000FF000000FF) * 0x0000271000000001)) >>
+      32;
+  return word;
+}
+
+// Parses 1 to 19 digits, which always fit.
+bool parseDigits(const char* data, const char* end, uint64_t* value) {
+  auto size = end - data;
+  if (size < 1 || size > 19) {
+    return false;
+  }
+  uint64_t ret = 0;
+  for (; end - data >= 8; data += 8) {
+    auto word = loadWord(data);
+    if (!matchesPattern(word, ~uint64_t(0), 0)) {
+      return false;
+    }
+    ret = ret * 100000000 + parseEightDigits(word);
+  }
+  for (; data != end; ++data) {
+    if (!isDigit(*data)) {
+      return false;
+    }
+    ret = ret * 10 + digitValue(*data);
+  }
+  *value = ret;
+  return true;
+}
+
+template <typename T>
+bool convertValue(folly::StringPiece value, T* out) {
+  if constexpr (std::is_integral_v<T>) {
+    // "-?[0-9]{1,19}", anything else goes through folly::tryTo below.
+    const char* data = value.begin();
+    bool negative = std::is_signed_v<T> && data != value.end() && *data == '-';
+    uint64_t magnitude;
+    if (parseDigits(data + negative, value.end(), &magnitude)) {
+      using Unsigned = std::make_unsigned_t<T>;
+      uint64_t max = std::numeric_limits<T>::max();
+      if (magnitude > max + negative) {
+        return false;
+      }
+      *out = static_cast<T>(
+          static_cast<Unsigned>(negative ? 0 - magnitude : magnitude));
+      return true;
+    }
+  } else if constexpr (std::is_same_v<T, double>) {
+    // "-?[0-9]+(\.[0-9]+)?" with at most 15 digits: the digits and the power
+    // of ten are exact doubles, so one division rounds correctly.
+    static constexpr uint64_t kPowersOfTen[] = {
+        1,
+        10,
+        100,
+        1000,
+        10000,
+        100000,
+        1000000,
+        10000000,
+        100000000,
+        1000000000,
+        10000000000,
+        100000000000,
+        1000000000000,
+        10000000000000,
+        100000000000000,
+        1000000000000000};
+    const char* data = value.begin();
+    const char* end = value.end();
+    bool negative = data != end && *data == '-';
+    data += negative;
+    auto dot = std::find(data, end, '.');
+    uint64_t integer = 0, fraction = 0;
+    auto fraction_digits = dot == end ? 0 : end - dot - 1;
+    if ((end - data) - (dot == end ? 0 : 1) <= 15 &&
+        parseDigits(data, dot, &integer) &&
+        (dot == end || parseDigits(dot + 1, end, &fraction))) {
+      auto scale = kPowersOfTen[fraction_digits];
+      double ret = static_cast<double>(integer * scale + fraction) /
+          static_cast<double>(scale);
+      *out = negative ? -ret : ret;
+      return true;
+    }
+  }
+
+  auto ret = folly::tryTo<T>(value);
+  if (ret.hasValue()) {
+    *out = ret.value();
+  }
+  return ret.hasValue();
+}
+
+template <typename T, typename Native>
+bool convertNativeValue(Native value, T* out) {
+  auto ret = folly::tryTo<T>(value);
+  if (ret.hasValue()) {
+    *out = ret.value();
+  }
+  return ret.hasValue();
+}
+
+} // namespace
+
+std::shared_ptr<RowFields> EphemeralRowFields::makeBufferedFields(
+    const std::vector<size_t>* columns) const {
+  auto num_fields = columns ? columns->size() : num_fields_;
+  if (num_fields == 0) {
     return nullptr;
   }
   std::vector<std::string> field_names;
   std::vector<std::string> table_names;
-  folly::StringKeyedUnorderedMap<int> field_name_map;
   std::vector<uint64_t> mysql_field_flags;
   std::vector<enum_field_types> mysql_field_types;
+  std::vector<uint8_t> mysql_field_decimals;
 
-  field_names.reserve(num_fields_);
-  for (int i = 0; i < num_fields_; ++i) {
-    MYSQL_FIELD* mysql_field = &fields_[i];
+  field_names.reserve(num_fields);
+  for (size_t i = 0; i < num_fields; ++i) {
+    MYSQL_FIELD* mysql_field = &fields_[columns ? (*columns)[i] : i];
     field_names.emplace_back(mysql_field->name, mysql_field->name_length);
     table_names.emplace_back(mysql_field->table, mysql_field->table_length);
     mysql_field_flags.push_back(mysql_field->flags);
     mysql_field_types.push_back(mysql_field->type);
-    field_name_map[mysql_field->name] = i;
+    mysql_field_decimals.push_back(mysql_field->decimals);
   }
   return std::make_shared<RowFields>(
-      std::move(field_name_map),
       std::move(field_names),
       std::move(table_names),
       std::move(mysql_field_flags),
-      std::move(mysql_field_types));
+      std::move(mysql_field_types),
+      std::move(mysql_field_decimals));
+}
+
+namespace {
+
+// The fields of an EphemeralRowFields copy and the text of their names.
+struct CopiedFields {
+  std::vector<MYSQL_FIELD> fields;
+  std::vector<char> text;
+};
+
+} // namespace
+
+std::shared_ptr<EphemeralRowFields> EphemeralRowFields::copy() const {
+  auto copied = std::make_shared<CopiedFields>();
+  size_t text_size = 0;
+  for (int i = 0; i < num_fields_; ++i) {
+    text_size += fields_[i].name_length + fields_[i].table_length + 2;
+  }
+  // Reserved up front so the pointers into it stay valid.
+  copied->text.reserve(text_size);
+  auto copyText = [&](const char* text, unsigned int length) {
+    char* copy = copied->text.data() + copied->text.size();
+    copied->text.insert(copied->text.end(), text, text + length);
+    copied->text.push_back('\0');
+    return copy;
+  };
+  // Only what EphemeralRowFields reads is copied, the other pointers of the
+  // MYSQL_FIELDs are left null.
+  copied->fields.resize(num_fields_);
+  for (int i = 0; i < num_fields_; ++i) {
+    const auto& field = fields_[i];
+    auto& copy = copied->fields[i];
+    copy.name = copyText(field.name, field.name_length);
+    copy.name_length = field.name_length;
+    copy.table = copyText(field.table, field.table_length);
+    copy.table_length = field.table_length;
+    copy.flags = field.flags;
+    copy.type = field.type;
+    copy.decimals = field.decimals;
+    copy.charsetnr = field.charsetnr;
+  }
+  auto result =
+      std::make_shared<EphemeralRowFields>(copied->fields.data(), num_fields_);
+  result->storage_ = std::move(copied);
+  return result;
 }
 
 folly::StringPiece EphemeralRow::operator[](size_t col) const {
@@ -65,6 +407,75 @@ uint64_t EphemeralRow::calculateRowLength() const {
   return rowLength;
 }
 
+void StreamedRowBatch::append(
+    const EphemeralRow& row,
+    std::shared_ptr<EphemeralRowFields> row_fields,
+    const std::vector<size_t>* columns) {
+  DCHECK(!row_fields_ || row_fields_ == row_fields);
+  if (!row_fields_ && !columns) {
+    row_fields_ = std::move(row_fields);
+  }
+  auto num_values = columns ? columns->size() : row.numFields();
+  for (size_t n = 0; n < num_values; ++n) {
+    auto i = columns ? (*columns)[n] : n;
+    if (row.isNull(i)) {
+      offsets_.push_back(kNullOffset);
+      lengths_.push_back(0);
+      continue;
+    }
+    auto value = row[i];
+    offsets_.push_back(data_.size());
+    lengths_.push_back(value.size());
+    value_bytes_ += value.size();
+    data_.insert(data_.end(), value.begin(), value.end());
+    data_.push_back('\0');
+  }
+  ++num_rows_;
+}
+
+EphemeralRow StreamedRowBatch::consumeRow() {
+  DCHECK(!empty());
+  if (values_.size() != offsets_.size()) {
+    values_.clear();
+    values_.reserve(offsets_.size());
+    for (auto offset : offsets_) {
+      values_.push_back(offset == kNullOffset ? nullptr : &data_[offset]);
+    }
+  }
+  DCHECK(row_fields_);
+  auto num_fields = row_fields_->numFields();
+  auto start = next_row_++ * num_fields;
+  return EphemeralRow(&values_[start], &lengths_[start], row_fields_.get());
+}
+
+void StreamedRowBatch::appendTo(RowBlock* block) const {
+  auto num_fields = block->numFields();
+  DCHECK_EQ(offsets_.size(), num_rows_ * num_fields);
+  for (size_t start = 0; start < offsets_.size(); start += num_fields) {
+    block->startRow();
+    for (auto i = start; i < start + num_fields; ++i) {
+      if (offsets_[i] == kNullOffset) {
+        block->appendNull();
+      } else {
+        block->appendValue(
+            folly::StringPiece(data_.data() + offsets_[i], lengths_[i]));
+      }
+    }
+    block->finishRow();
+  }
+}
+
+void StreamedRowBatch::clear() {
+  data_.clear();
+  offsets_.clear();
+  lengths_.clear();
+  values_.clear();
+  num_rows_ = 0;
+  next_row_ = 0;
+  value_bytes_ = 0;
+  row_fields_.reset();
+}
+
 Row::Row(const RowBlock* row_block, size_t row_number)
     : row_block_(row_block), row_number_(row_number) {
   CHECK_LT(row_number, row_block->numRows());
@@ -98,6 +509,17 @@ auto Row::end() const -> Iterator {
   return Iterator(this, size());
 }
 
+JsonView Row::getJson(folly::StringPiece l) const {
+  return getJson(row_block_->fieldIndex(l));
+}
+
+JsonView Row::getJson(size_t l) const {
+  if (row_block_->isNull(row_number_, l)) {
+    return JsonView(folly::StringPiece());
+  }
+  return JsonView(row_block_->getField<folly::StringPiece>(row_number_, l));
+}
+
 folly::dynamic Row::getDynamic(folly::StringPiece l) const {
   return getDynamic(row_block_->fieldIndex(l));
 }
@@ -138,12 +560,151 @@ folly::dynamic Row::getDynamic(size_t l) const {
   }
 }
 
+size_t RowBlock::allocatedBytes() const {
+  size_t bytes = buffer_.capacity() + null_values_.capacity() / 8 +
+      field_offsets_.capacity() * sizeof(size_t) +
+      pooled_values_.capacity() * sizeof(folly::StringPiece) +
+      pooled_buffer_.allocatedBytes() +
+      field_storage_.capacity() * sizeof(FieldStorage) +
+      columns_.capacity() * sizeof(Column) +
+      mapped_columns_.capacity() * sizeof(MappedColumn);
+  bytes += external_rows_.capacity() * sizeof(MYSQL_ROW) +
+      external_lengths_.capacity() * sizeof(uint32_t);
+  for (const auto& column : columns_) {
+    bytes += column.buffer.capacity() +
+        column.ends.capacity() * sizeof(uint32_t) +
+        column.nulls.capacity() * sizeof(uint64_t);
+  }
+  bytes += dictionaries_.capacity() * sizeof(Dictionary);
+  for (const auto& dictionary : dictionaries_) {
+    bytes += dictionary.index.getAllocatedMemorySize() +
+        dictionary.values.capacity() * sizeof(folly::StringPiece) +
+        dictionary.value_bytes +
+        dictionary.codes.capacity() * sizeof(uint32_t);
+  }
+  return bytes;
+}
+
+void RowBlock::setDictionaryEncoding(size_t max_distinct, size_t sample_rows) {
+  CHECK(empty());
+  CHECK_GT(sample_rows, 0);
+  if (layout_ != RowBlockLayout::Rows && layout_ != RowBlockLayout::Columns) {
+    return;
+  }
+  dictionary_max_distinct_ = max_distinct;
+  dictionary_sample_rows_ = sample_rows;
+  dictionaries_.clear();
+  dictionaries_.resize(numFields());
+  for (size_t field_num = 0; field_num < numFields(); ++field_num) {
+    if (getFieldStorage(field_num) != FieldStorage::Text) {
+      continue;
+    }
+    switch (getFieldType(field_num)) {
+      case MYSQL_TYPE_VARCHAR:
+      case MYSQL_TYPE_VAR_STRING:
+      case MYSQL_TYPE_STRING:
+      case MYSQL_TYPE_ENUM:
+      case MYSQL_TYPE_SET:
+        dictionaries_[field_num].state = DictionaryState::Sampling;
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+bool RowBlock::encodeValue(const char* data, size_t size, bool null) {
+  auto& dictionary = dictionaries_[numValues() % numFields()];
+  if (dictionary.state == DictionaryState::Off ||
+      dictionary.state == DictionaryState::Capped) {
+    return false;
+  }
+  if (null) {
+    dictionary.codes.push_back(kNullCode);
+  } else {
+    folly::StringPiece value(data, size);
+    auto it = dictionary.index.find(value);
+    if (it == dictionary.index.end()) {
+      if (dictionary.state == DictionaryState::Coded &&
+          dictionary.values.size() == dictionary_max_distinct_) {
+        // The dictionary is full, stop coding instead of growing it.
+        dictionary.state = DictionaryState::Capped;
+        dictionary.end_coded_row = dictionary.codes.size();
+        return false;
+      }
+      it = dictionary.index
+               .emplace(value.str(), uint32_t(dictionary.values.size()))
+               .first;
+      dictionary.values.push_back(it->first);
+      dictionary.value_bytes += size;
+    }
+    dictionary.codes.push_back(it->second);
+  }
+  if (dictionary.state == DictionaryState::Coded) {
+    return !null;
+  }
+
+  // Sampling: values are stored as usual until the sample decides.
+  if (dictionary.values.size() > dictionary_max_distinct_) {
+    dictionary = Dictionary();
+  } else if (dictionary.codes.size() == dictionary_sample_rows_) {
+    dictionary.state = DictionaryState::Coded;
+    dictionary.first_coded_row = dictionary.codes.size();
+  }
+  return false;
+}
+
+void RowBlock::appendExternalRow(const EphemeralRow& row) {
+  DCHECK(layout_ == RowBlockLayout::External);
+  DCHECK_EQ(row.numFields(), numFields());
+  external_rows_.push_back(row.mysql_row_);
+  for (int i = 0; i < row.numFields(); ++i) {
+    CHECK_LE(row.field_lengths_[i], std::numeric_limits<uint32_t>::max());
+    external_lengths_.push_back(row.field_lengths_[i]);
+  }
+}
+
 template <>
 folly::StringPiece RowBlock::getField(size_t row, size_t field_num) const {
-  size_t entry = row * row_fields_info_->numFields() + field_num;
-  if (null_values_[entry]) {
+  if (isNull(row, field_num)) {
     return folly::StringPiece(nullptr, nullptr);
   }
+  if (getFieldStorage(field_num) != FieldStorage::Text) {
+    throw std::range_error(folly::sformat(
+        "Field {} is stored natively and can't be read as text", field_num));
+  }
+  auto value = rawValue(row, field_num);
+  return !value.empty() ? value : folly::StringPiece();
+}
+
+folly::StringPiece RowBlock::rawValue(size_t row, size_t field_num) const {
+  if (hasCodedValues(field_num)) {
+    const auto& dictionary = dictionaries_[field_num];
+    if (row >= dictionary.first_coded_row && row < dictionary.end_coded_row) {
+      return dictionary.values[dictionary.codes[row]];
+    }
+  }
+  if (layout_ == RowBlockLayout::Columns) {
+    const auto& column = columns_[field_num];
+    auto begin = column.begin(row);
+    return folly::StringPiece(
+        column.buffer.data() + begin, column.ends[row] - begin);
+  }
+  if (layout_ == RowBlockLayout::Mapped) {
+    const auto& column = mapped_columns_[field_num];
+    auto begin = column.begin(row);
+    return folly::StringPiece(column.buffer + begin, column.ends[row] - begin);
+  }
+
+  size_t entry = row * row_fields_info_->numFields() + field_num;
+  if (layout_ == RowBlockLayout::External) {
+    return folly::StringPiece(
+        external_rows_[row][field_num], external_lengths_[entry]);
+  }
+
+  if (pooled_buffer_.hasPool()) {
+    return pooled_values_[entry];
+  }
 
   size_t field_size;
 
@@ -153,15 +714,189 @@ folly::StringPiece RowBlock::getField(size_t row, size_t field_num) const {
     field_size = field_offsets_[entry + 1] - field_offsets_[entry];
   }
 
-  return field_size != 0
-      ? folly::StringPiece(&buffer_[field_offsets_[entry]], field_size)
-      : folly::StringPiece();
+  return folly::StringPiece(buffer_.data() + field_offsets_[entry], field_size);
+}
+
+void RowBlock::spill(SpillFile& file) {
+  if (layout_ == RowBlockLayout::Mapped || empty()) {
+    return;
+  }
+  std::vector<folly::ByteRange> parts;
+  std::deque<std::string> scratch;
+  auto size = appendColumnParts(parts, scratch);
+
+  // Throws before the block is changed.
+  auto mapping = file.append(parts);
+  folly::ByteRange data(
+      reinterpret_cast<const unsigned char*>(mapping.get()), size);
+  auto num_rows = numRows();
+  *this = fromColumnParts(
+      row_fields_info_,
+      std::move(field_storage_),
+      num_rows,
+      data,
+      std::move(mapping));
+}
+
+namespace {
+
+constexpr size_t kColumnPartAlignment = 8;
+const unsigned char kColumnPartPadding[kColumnPartAlignment] = {};
+
+size_t alignedPartSize(size_t size) {
+  return (size + kColumnPartAlignment - 1) / kColumnPartAlignment *
+      kColumnPartAlignment;
+}
+
+} // namespace
+
+size_t RowBlock::appendColumnParts(
+    std::vector<folly::ByteRange>& parts,
+    std::deque<std::string>& scratch) const {
+  auto num_rows = numRows();
+  auto mask_words = (num_rows + 63) / 64;
+  size_t total = 0;
+  auto append = [&](const void* data, size_t size) {
+    if (size > 0) {
+      parts.emplace_back(static_cast<const unsigned char*>(data), size);
+    }
+    auto padding = alignedPartSize(size) - size;
+    if (padding > 0) {
+      parts.emplace_back(kColumnPartPadding, padding);
+    }
+    total += size + padding;
+  };
+
+  for (size_t field_num = 0; field_num < numFields(); ++field_num) {
+    if (layout_ == RowBlockLayout::Columns && !hasCodedValues(field_num)) {
+      const auto& column = columns_[field_num];
+      append(column.nulls.data(), mask_words * sizeof(uint64_t));
+      append(column.ends.data(), num_rows * sizeof(uint32_t));
+      append(column.buffer.data(), column.buffer.size());
+      continue;
+    }
+    if (layout_ == RowBlockLayout::Mapped) {
+      const auto& column = mapped_columns_[field_num];
+      append(column.nulls, mask_words * sizeof(uint64_t));
+      append(column.ends, num_rows * sizeof(uint32_t));
+      append(column.buffer, num_rows > 0 ? column.ends[num_rows - 1] : 0);
+      continue;
+    }
+
+    // Other layouts are encoded a column at a time.
+    std::vector<uint64_t> nulls(mask_words);
+    std::vector<uint32_t> ends;
+    ends.reserve(num_rows);
+    std::string values;
+    for (size_t row = 0; row < num_rows; ++row) {
+      if (isNull(row, field_num)) {
+        nulls[row / 64] |= uint64_t(1) << (row % 64);
+      } else {
+        auto value = rawValue(row, field_num);
+        values.append(value.data(), value.size());
+        CHECK_LE(values.size(), std::numeric_limits<uint32_t>::max());
+      }
+      ends.push_back(static_cast<uint32_t>(values.size()));
+    }
+    auto& column = scratch.emplace_back();
+    auto append_scratch = [&](const void* data, size_t size) {
+      column.append(static_cast<const char*>(data), size);
+      column.resize(alignedPartSize(column.size()));
+    };
+    append_scratch(nulls.data(), mask_words * sizeof(uint64_t));
+    append_scratch(ends.data(), num_rows * sizeof(uint32_t));
+    append_scratch(values.data(), values.size());
+    append(column.data(), column.size());
+  }
+  return total;
+}
+
+RowBlock RowBlock::fromColumnParts(
+    std::shared_ptr<RowFields> row_fields,
+    std::vector<FieldStorage> field_storage,
+    size_t num_rows,
+    folly::ByteRange data,
+    std::shared_ptr<const void> owner) {
+  CHECK_EQ(
+      reinterpret_cast<uintptr_t>(data.data()) % kColumnPartAlignment, 0);
+  RowBlock block(std::move(row_fields));
+  block.layout_ = RowBlockLayout::Mapped;
+  block.field_storage_ = std::move(field_storage);
+  block.external_owner_ = std::move(owner);
+  auto num_fields = block.numFields();
+  DCHECK(
+      block.field_storage_.empty() ||
+      block.field_storage_.size() == num_fields);
+
+  auto mask_words = (num_rows + 63) / 64;
+  size_t offset = 0;
+  auto take = [&](size_t size) {
+    auto padded = alignedPartSize(size);
+    if (data.size() - offset < padded) {
+      throw std::out_of_range(folly::sformat(
+          "Column data of {} bytes is truncated at {}", data.size(), offset));
+    }
+    const auto* part = data.data() + offset;
+    offset += padded;
+    return reinterpret_cast<const char*>(part);
+  };
+  block.mapped_columns_.reserve(num_fields);
+  for (size_t field_num = 0; field_num < num_fields; ++field_num) {
+    auto* nulls = take(mask_words * sizeof(uint64_t));
+    auto* ends = reinterpret_cast<const uint32_t*>(
+        take(num_rows * sizeof(uint32_t)));
+    auto* values = take(num_rows > 0 ? ends[num_rows - 1] : 0);
+    block.mapped_columns_.push_back(MappedColumn{
+        values, ends, reinterpret_cast<const uint64_t*>(nulls)});
+  }
+  block.num_column_values_ = num_rows * num_fields;
+  return block;
+}
+
+template <>
+std::string RowBlock::getField(size_t row, size_t field_num) const {
+  if (isNull(row, field_num)) {
+    return std::string();
+  }
+  switch (getFieldStorage(field_num)) {
+    case FieldStorage::Int64:
+      return folly::to<std::string>(getNativeField<int64_t>(row, field_num));
+    case FieldStorage::UInt64:
+      return folly::to<std::string>(getNativeField<uint64_t>(row, field_num));
+    case FieldStorage::Double:
+      return folly::to<std::string>(getNativeField<double>(row, field_num));
+    case FieldStorage::DateTime: {
+      char text[kMaxMysqlTimeLength];
+      auto size = formatMysqlTime(
+          getNativeField<MYSQL_TIME>(row, field_num),
+          getFieldType(field_num),
+          getFieldDecimals(field_num),
+          text);
+      return std::string(text, size);
+    }
+    case FieldStorage::Text:
+      break;
+  }
+  return getField<folly::StringPiece>(row, field_num).str();
 }
 
 template <>
 std::chrono::system_clock::time_point RowBlock::getField(
     size_t row,
     size_t field_num) const {
+  if (getFieldStorage(field_num) == FieldStorage::DateTime &&
+      !isNull(row, field_num) && isDate(row, field_num)) {
+    auto time = getNativeField<MYSQL_TIME>(row, field_num);
+    CivilTime civil;
+    civil.year = time.year;
+    civil.month = time.month;
+    civil.day = time.day;
+    civil.hour = time.hour;
+    civil.minute = time.minute;
+    civil.second = time.second;
+    civil.microseconds = time.second_part;
+    return toTimePoint(civil);
+  }
   auto field_value = getField<folly::StringPiece>(row, field_num);
   return parseDateTime(field_value, getFieldType(field_num));
 }
@@ -169,6 +904,15 @@ std::chrono::system_clock::time_point RowBlock::getField(
 template <>
 std::chrono::microseconds RowBlock::getField(size_t row, size_t field_num)
     const {
+  if (getFieldStorage(field_num) == FieldStorage::DateTime &&
+      !isNull(row, field_num) && getFieldType(field_num) == MYSQL_TYPE_TIME) {
+    auto time = getNativeField<MYSQL_TIME>(row, field_num);
+    // Like parseTimeOnly, the sign only applies to the hours.
+    int hours = time.day * 24 + time.hour;
+    return std::chrono::hours(time.neg ? -hours : hours) +
+        std::chrono::minutes(time.minute) + std::chrono::seconds(time.second) +
+        std::chrono::microseconds(time.second_part);
+  }
   auto field_value = getField<folly::StringPiece>(row, field_num);
   return parseTimeOnly(field_value, getFieldType(field_num));
 }
@@ -182,8 +926,8 @@ time_t RowBlock::getField(size_t row, size_t field_num) const {
 }
 
 time_t RowBlock::getDateField(size_t row, size_t field_num) const {
-  auto field_value = getField<folly::StringPiece>(row, field_num);
-  auto chrono_time = parseDateTime(field_value, getFieldType(field_num));
+  auto chrono_time =
+      getField<std::chrono::system_clock::time_point>(row, field_num);
   time_t field_timet = std::chrono::system_clock::to_time_t(chrono_time);
   if (field_timet == -1) {
     throw std::range_error("Calendar time cannot be represented as time_t");
@@ -191,75 +935,241 @@ time_t RowBlock::getDateField(size_t row, size_t field_num) const {
   return field_timet;
 }
 
+template <typename T>
+ColumnDecodeStatus RowBlock::decodeColumn(
+    size_t field_num,
+    folly::Range<T*> values,
+    folly::Range<uint64_t*> null_mask) const {
+  auto num_rows = numRows();
+  CHECK_EQ(values.size(), num_rows);
+  CHECK(null_mask.empty() || null_mask.size() >= (num_rows + 63) / 64);
+  std::fill(null_mask.begin(), null_mask.end(), 0);
+
+  ColumnDecodeStatus status;
+  auto decoded = [&](size_t row, bool ok) {
+    if (!ok) {
+      values[row] = T();
+      ++status.num_errors;
+      if (!status.first_error_row) {
+        status.first_error_row = row;
+      }
+    }
+  };
+  auto null = [&](size_t row) {
+    values[row] = T();
+    ++status.num_nulls;
+    if (!null_mask.empty()) {
+      null_mask[row / 64] |= uint64_t(1) << (row % 64);
+    }
+  };
+
+  auto storage = getFieldStorage(field_num);
+  if (layout_ == RowBlockLayout::Columns && storage == FieldStorage::Text &&
+      !hasCodedValues(field_num)) {
+    // Walks the column's buffer and offsets directly.
+    const auto& column = columns_[field_num];
+    uint32_t begin = 0;
+    for (size_t row = 0; row < num_rows; ++row) {
+      auto end = column.ends[row];
+      if (column.isNull(row)) {
+        null(row);
+      } else {
+        folly::StringPiece value(column.buffer.data() + begin, end - begin);
+        decoded(row, convertValue(value, &values[row]));
+      }
+      begin = end;
+    }
+    return status;
+  }
+
+  for (size_t row = 0; row < num_rows; ++row) {
+    if (isNull(row, field_num)) {
+      null(row);
+      continue;
+    }
+    T* out = &values[row];
+    switch (storage) {
+      case FieldStorage::Text:
+        decoded(
+            row,
+            convertValue(getField<folly::StringPiece>(row, field_num), out));
+        break;
+      case FieldStorage::Int64:
+        decoded(
+            row,
+            convertNativeValue(getNativeField<int64_t>(row, field_num), out));
+        break;
+      case FieldStorage::UInt64:
+        decoded(
+            row,
+            convertNativeValue(getNativeField<uint64_t>(row, field_num), out));
+        break;
+      case FieldStorage::Double:
+        decoded(
+            row,
+            convertNativeValue(getNativeField<double>(row, field_num), out));
+        break;
+      case FieldStorage::DateTime:
+        decoded(row, false);
+        break;
+    }
+  }
+  return status;
+}
+
+template ColumnDecodeStatus RowBlock::decodeColumn(
+    size_t,
+    folly::Range<signed char*>,
+    folly::Range<uint64_t*>) const;
+template ColumnDecodeStatus RowBlock::decodeColumn(
+    size_t,
+    folly::Range<short*>,
+    folly::Range<uint64_t*>) const;
+template ColumnDecodeStatus
+RowBlock::decodeColumn(size_t, folly::Range<int*>, folly::Range<uint64_t*>)
+    const;
+template ColumnDecodeStatus
+RowBlock::decodeColumn(size_t, folly::Range<long*>, folly::Range<uint64_t*>)
+    const;
+template ColumnDecodeStatus RowBlock::decodeColumn(
+    size_t,
+    folly::Range<long long*>,
+    folly::Range<uint64_t*>) const;
+template ColumnDecodeStatus RowBlock::decodeColumn(
+    size_t,
+    folly::Range<unsigned char*>,
+    folly::Range<uint64_t*>) const;
+template ColumnDecodeStatus RowBlock::decodeColumn(
+    size_t,
+    folly::Range<unsigned short*>,
+    folly::Range<uint64_t*>) const;
+template ColumnDecodeStatus RowBlock::decodeColumn(
+    size_t,
+    folly::Range<unsigned int*>,
+    folly::Range<uint64_t*>) const;
+template ColumnDecodeStatus RowBlock::decodeColumn(
+    size_t,
+    folly::Range<unsigned long*>,
+    folly::Range<uint64_t*>) const;
+template ColumnDecodeStatus RowBlock::decodeColumn(
+    size_t,
+    folly::Range<unsigned long long*>,
+    folly::Range<uint64_t*>) const;
+template ColumnDecodeStatus RowBlock::decodeColumn(
+    size_t,
+    folly::Range<float*>,
+    folly::Range<uint64_t*>) const;
+template ColumnDecodeStatus RowBlock::decodeColumn(
+    size_t,
+    folly::Range<double*>,
+    folly::Range<uint64_t*>) const;
+
+size_t formatMysqlTime(
+    const MYSQL_TIME& time,
+    enum_field_types field_type,
+    unsigned decimals,
+    char* out) {
+  int size;
+  switch (field_type) {
+    case MYSQL_TYPE_DATE:
+      size = snprintf(
+          out,
+          kMaxMysqlTimeLength,
+          "%04u-%02u-%02u",
+          time.year,
+          time.month,
+          time.day);
+      break;
+    case MYSQL_TYPE_TIME:
+      size = snprintf(
+          out,
+          kMaxMysqlTimeLength,
+          "%s%02u:%02u:%02u",
+          time.neg ? "-" : "",
+          time.day * 24 + time.hour,
+          time.minute,
+          time.second);
+      break;
+    default:
+      size = snprintf(
+          out,
+          kMaxMysqlTimeLength,
+          "%04u-%02u-%02u %02u:%02u:%02u",
+          time.year,
+          time.month,
+          time.day,
+          time.hour,
+          time.minute,
+          time.second);
+      break;
+  }
+  if (decimals > 6) {
+    decimals = time.second_part != 0 ? 6 : 0;
+  }
+  if (field_type != MYSQL_TYPE_DATE && decimals > 0 &&
+      static_cast<size_t>(size) < kMaxMysqlTimeLength) {
+    // Microseconds, cut to the field's digits like the server does.
+    unsigned long fraction = time.second_part;
+    for (unsigned i = decimals; i < 6; ++i) {
+      fraction /= 10;
+    }
+    size += snprintf(
+        out + size,
+        kMaxMysqlTimeLength - size,
+        ".%0*lu",
+        static_cast<int>(decimals),
+        fraction);
+  }
+  return std::min<size_t>(size, kMaxMysqlTimeLength - 1);
+}
+
 std::chrono::microseconds parseTimeOnly(
     folly::StringPiece mysql_time,
     enum_field_types field_type) {
-  static re2::RE2 time_pattern(
-      "([-]?\\d{1,3}):(\\d{2}):(\\d{2})(?:\\.(\\d{1,6}))?");
-  int hours = 0, minutes = 0, seconds = 0, microseconds = 0;
-  std::string microseconds_str;
   if (field_type != MYSQL_TYPE_TIME) {
     throw std::range_error("No conversion available");
   }
 
-  re2::StringPiece re2_mysql_time(mysql_time.data(), mysql_time.size());
-  if (!re2::RE2::FullMatch(
-          re2_mysql_time.data(),
-          time_pattern,
-          &hours,
-          &minutes,
-          &seconds,
-          &microseconds_str)) {
-    throw std::range_error("Can't parse time");
+  // "[-]H{1,3}:MM:SS[.ffffff]"
+  const char* p = mysql_time.begin();
+  const char* end = mysql_time.end();
+  bool negative = p != end && *p == '-';
+  if (negative) {
+    ++p;
+  }
+  int hours = 0, minutes = 0, seconds = 0, microseconds = 0;
+  int hour_digits = 0;
+  for (; p != end && isDigit(*p) && hour_digits < 3; ++p, ++hour_digits) {
+    hours = hours * 10 + digitValue(*p);
   }
-  if (!microseconds_str.empty()) {
-    microseconds_str.resize(6, '0');
-    microseconds = folly::to<int>(microseconds_str.c_str());
+  if (hour_digits == 0 || end - p < 6 || p[0] != ':' || !isDigit(p[1]) ||
+      !isDigit(p[2]) || p[3] != ':' || !isDigit(p[4]) || !isDigit(p[5]) ||
+      !parseFraction(p + 6, end, &microseconds)) {
+    throw std::range_error("Can't parse time");
   }
-  auto result = std::chrono::hours(hours) + std::chrono::minutes(minutes) +
-      std::chrono::seconds(seconds) + std::chrono::microseconds(microseconds);
+  minutes = digitValue(p[1]) * 10 + digitValue(p[2]);
+  seconds = digitValue(p[4]) * 10 + digitValue(p[5]);
+
+  // The sign only applies to the hours.
+  auto result = std::chrono::hours(negative ? -hours : hours) +
+      std::chrono::minutes(minutes) + std::chrono::seconds(seconds) +
+      std::chrono::microseconds(microseconds);
   return result;
 }
 
 std::chrono::system_clock::time_point parseDateTime(
     folly::StringPiece datetime,
     enum_field_types date_type) {
-  const int TM_YEAR_BASE = 1900;
-
-  // Clean struct and set daylight savings to information not available
-  struct tm time_tm = {0};
-
-  time_tm.tm_isdst = -1;
-  std::string microseconds_str;
-  int microseconds = 0;
-
+  CivilTime civil;
   bool parse_succeeded = false;
-  re2::StringPiece re2_datetime(datetime.data(), datetime.size());
   switch (date_type) {
     case MYSQL_TYPE_TIMESTAMP:
     case MYSQL_TYPE_DATETIME:
-      static re2::RE2 timestamp_pattern(
-          "(\\d{4})-(\\d{2})-(\\d{2}) "
-          "(\\d{2}):(\\d{2}):(\\d{2})(?:\\.(\\d{1,6}))?");
-      parse_succeeded = re2::RE2::FullMatch(
-          re2_datetime,
-          timestamp_pattern,
-          &time_tm.tm_year,
-          &time_tm.tm_mon,
-          &time_tm.tm_mday,
-          &time_tm.tm_hour,
-          &time_tm.tm_min,
-          &time_tm.tm_sec,
-          &microseconds_str);
+      parse_succeeded = parseDateAndTime(datetime, &civil);
       break;
     case MYSQL_TYPE_DATE:
-      static re2::RE2 date_pattern("(\\d{4})-(\\d{2})-(\\d{2})");
-      parse_succeeded = re2::RE2::FullMatch(
-          re2_datetime,
-          date_pattern,
-          &time_tm.tm_year,
-          &time_tm.tm_mon,
-          &time_tm.tm_mday);
+      parse_succeeded =
+          datetime.size() == 10 && parseDate(datetime.data(), &civil);
       break;
     default:
       break;
@@ -268,29 +1178,8 @@ std::chrono::system_clock::time_point parseDateTime(
   if (!parse_succeeded) {
     throw std::range_error("Can't parse date");
   }
-  if (!microseconds_str.empty()) {
-    microseconds_str.resize(6, '0');
-    microseconds = folly::to<int>(microseconds_str.c_str());
-  }
-
-  if (time_tm.tm_year) {
-    time_tm.tm_year -= TM_YEAR_BASE;
-  }
-
-  if (time_tm.tm_mon) {
-    time_tm.tm_mon -= 1;
-  }
-
-  auto t = mktime(&time_tm);
-
-  if (t == -1) {
-    throw std::range_error("Date values are invalid");
-  }
-
-  auto chrono_time = std::chrono::system_clock::from_time_t(t);
 
-  chrono_time = chrono_time + std::chrono::microseconds(microseconds);
-  return chrono_time;
+  return toTimePoint(civil);
 }
 } // namespace mysql_client
 } // namespace common
@@ -18,6 +18,11 @@
 #ifndef COMMON_ASYNC_MYSQL_ROW_H
 #define COMMON_ASYNC_MYSQL_ROW_H
 
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <optional>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -26,19 +31,23 @@
 #include <mysql.h>
 #include <chrono>
 
-#include <re2/re2.h>
-
 #include <folly/Conv.h>
 #include <folly/Format.h>
 #include <folly/Range.h>
+#include <folly/container/F14Map.h>
 #include <folly/dynamic.h>
 #include <folly/experimental/StringKeyedUnorderedMap.h>
 #include <folly/hash/Hash.h>
 
+#include "squangle/mysql_client/JsonView.h"
+#include "squangle/mysql_client/RowBufferPool.h"
+#include "squangle/mysql_client/SpillFile.h"
+
 namespace facebook {
 namespace common {
 namespace mysql_client {
 
+class EphemeralRow;
 class RowBlock;
 
 // A row of returned data.  This makes the columns available either
@@ -75,6 +84,11 @@ class Row {
   folly::dynamic getDynamic(size_t l) const;
   folly::dynamic getDynamic(folly::StringPiece l) const;
 
+  // A lazily parsed view of a JSON column; NULL is viewed as JSON null.  The
+  // view points into the RowBlock, which must outlive it.
+  JsonView getJson(size_t l) const;
+  JsonView getJson(folly::StringPiece l) const;
+
   // Vector-like and map-like access.  Note the above about ambiguity
   // for map access when column names conflict.
   size_t size() const;
@@ -122,21 +136,122 @@ class Row {
   const size_t row_number_;
 };
 
+// Maps field names to field numbers.  This is an open addressing table of
+// (hash, field number) pairs kept at most half full, so a lookup hashes the
+// name once and usually compares it against a single field name.  Names
+// aren't stored: callers pass a function returning the name of a field
+// number, which keeps the index valid when its owner is copied or moved.
+class FieldNameIndex {
+ public:
+  FieldNameIndex() = default;
+
+  // `name_of(i)` returns the name of field i.  When names repeat, the first
+  // field with the name is found, or the last one if `prefer_last`.
+  template <typename NameOf>
+  FieldNameIndex(size_t num_fields, const NameOf& name_of, bool prefer_last) {
+    if (num_fields == 0) {
+      return;
+    }
+    size_t size = 4;
+    while (size < num_fields * 2) {
+      size *= 2;
+    }
+    slots_.assign(size, 0);
+    for (size_t n = 0; n < num_fields; ++n) {
+      auto field_num = prefer_last ? num_fields - 1 - n : n;
+      auto name = name_of(field_num);
+      auto hash = hashName(name);
+      for (auto slot = hash & (size - 1);; slot = (slot + 1) & (size - 1)) {
+        if (slots_[slot] == 0) {
+          slots_[slot] = (hash & kHashMask) | (field_num + 1);
+          break;
+        }
+        if (matches(slots_[slot], hash, name, name_of)) {
+          break;
+        }
+      }
+    }
+  }
+
+  template <typename NameOf>
+  std::optional<size_t> find(folly::StringPiece name, const NameOf& name_of)
+      const {
+    if (slots_.empty()) {
+      return std::nullopt;
+    }
+    auto hash = hashName(name);
+    auto mask = slots_.size() - 1;
+    for (auto slot = hash & mask; slots_[slot] != 0; slot = (slot + 1) & mask) {
+      if (matches(slots_[slot], hash, name, name_of)) {
+        return (slots_[slot] & ~kHashMask) - 1;
+      }
+    }
+    return std::nullopt;
+  }
+
+ private:
+  // The high half of a slot holds the high half of the name's hash, the low
+  // half the field number plus one, so empty slots are 0.
+  static constexpr uint64_t kHashMask = 0xFFFFFFFF00000000;
+
+  static uint64_t hashName(folly::StringPiece name) {
+    return folly::hasher<folly::StringPiece>()(name);
+  }
+
+  template <typename NameOf>
+  static bool matches(
+      uint64_t slot,
+      uint64_t hash,
+      folly::StringPiece name,
+      const NameOf& name_of) {
+    return ((slot ^ hash) & kHashMask) == 0 &&
+        name_of((slot & ~kHashMask) - 1) == name;
+  }
+
+  std::vector<uint64_t> slots_;
+};
+
+// Decimals of fields without a fixed number of them, as MySQL reports for
+// some expressions, and of fields whose decimals aren't known.
+constexpr unsigned kUnknownDecimals = 31;
+
 // RowFields encapsulates the data about the fields (name, flags, types).
 class RowFields {
  public:
+  // `mysql_field_decimals` may be empty if they aren't known.
   RowFields(
-      folly::StringKeyedUnorderedMap<int>&& field_name_map,
       std::vector<std::string>&& field_names,
       std::vector<std::string>&& table_names,
       std::vector<uint64_t>&& mysql_field_flags,
-      std::vector<enum_field_types>&& mysql_field_types)
+      std::vector<enum_field_types>&& mysql_field_types,
+      std::vector<uint8_t>&& mysql_field_decimals = {})
       : num_fields_(field_names.size()),
-        field_name_map_(std::move(field_name_map)),
         field_names_(std::move(field_names)),
+        field_name_index_(
+            num_fields_,
+            [this](size_t i) { return fieldName(i); },
+            /*prefer_last=*/true),
         table_names_(std::move(table_names)),
         mysql_field_flags_(std::move(mysql_field_flags)),
-        mysql_field_types_(std::move(mysql_field_types)) {}
+        mysql_field_types_(std::move(mysql_field_types)),
+        mysql_field_decimals_(std::move(mysql_field_decimals)) {}
+
+  // For callers that still build a map from field names to field numbers.
+  // The map is ignored: names are looked up in an index built from
+  // `field_names`, which finds the last field with a repeated name like the
+  // map built by makeBufferedFields did.
+  RowFields(
+      folly::StringKeyedUnorderedMap<int>&& /*field_name_map*/,
+      std::vector<std::string>&& field_names,
+      std::vector<std::string>&& table_names,
+      std::vector<uint64_t>&& mysql_field_flags,
+      std::vector<enum_field_types>&& mysql_field_types)
+      : RowFields(
+            std::move(field_names),
+            std::move(table_names),
+            std::move(mysql_field_flags),
+            std::move(mysql_field_types)) {}
+
   // Get the MySQL type of the field.
   enum_field_types getFieldType(size_t field_num) const {
     return mysql_field_types_[field_num];
@@ -157,9 +272,16 @@ class RowFields {
     return mysql_field_flags_[fieldIndex(field_name)];
   }
 
+  // Get the MySQL decimals of the field, e.g. the fractional digits of
+  // temporal fields.
+  unsigned getFieldDecimals(size_t field_num) const {
+    return mysql_field_decimals_.empty() ? kUnknownDecimals
+                                         : mysql_field_decimals_[field_num];
+  }
+
   // Check if the row contains the field name.
   bool containsFieldName(folly::StringPiece field_name) const {
-    return field_name_map_.find(field_name) != field_name_map_.end();
+    return fieldIndexOpt(field_name).has_value();
   }
 
   // What is the name of the i'th column in the result set?
@@ -179,13 +301,10 @@ class RowFields {
   }
 
   // Given a field_name, return the numeric column number, or die trying.
+  // If several fields have the name, the last one is returned.
   std::optional<size_t> fieldIndexOpt(folly::StringPiece field_name) const {
-    auto it = field_name_map_.find(field_name);
-    if (it != field_name_map_.end()) {
-      return it->second;
-    }
-
-    return std::nullopt;
+    return field_name_index_.find(
+        field_name, [this](size_t i) { return fieldName(i); });
   }
 
   size_t fieldIndex(folly::StringPiece field_name) const {
@@ -198,11 +317,12 @@ class RowFields {
 
  private:
   size_t num_fields_;
-  const folly::StringKeyedUnorderedMap<int> field_name_map_;
   const std::vector<std::string> field_names_;
+  const FieldNameIndex field_name_index_;
   const std::vector<std::string> table_names_;
   const std::vector<uint64_t> mysql_field_flags_;
   const std::vector<enum_field_types> mysql_field_types_;
+  const std::vector<uint8_t> mysql_field_decimals_;
 
   friend class RowBlock;
 };
@@ -215,6 +335,63 @@ std::chrono::microseconds parseTimeOnly(
     folly::StringPiece mysql_time,
     enum_field_types field_type);
 
+// Room formatMysqlTime needs, with the terminating NUL.
+constexpr size_t kMaxMysqlTimeLength = 64;
+
+// Writes a MYSQL_TIME to `out` the way the text protocol sends it for a
+// field with `decimals` fractional digits.  With kUnknownDecimals the
+// fractional part is written with 6 digits, only when it isn't zero.
+// Returns the length of the text.
+size_t formatMysqlTime(
+    const MYSQL_TIME& time,
+    enum_field_types field_type,
+    unsigned decimals,
+    char* out);
+
+// How the values of a column are stored in a RowBlock.  Text protocol
+// results are always stored as Text; binary protocol results may keep
+// fixed width types in their native form.
+enum class FieldStorage : uint8_t {
+  Text,
+  Int64,
+  UInt64,
+  Double,
+  // MYSQL_TIME, for DATE, DATETIME, TIMESTAMP and TIME columns.
+  DateTime,
+};
+
+// How a RowBlock lays out its values in memory.
+enum class RowBlockLayout : uint8_t {
+  // All values in one buffer in row order, with an offset and a null flag
+  // per value.
+  Rows,
+  // A buffer per column with 32 bit offsets and a null bitmap.  Takes less
+  // memory for narrow columns and keeps each column contiguous.
+  Columns,
+  // Rows that stay in memory owned by someone else, e.g. a MYSQL_RES
+  // buffered by mysql_store_result.  Only a pointer per row and a length per
+  // value are kept.  Blocks get this layout from the adopting constructor.
+  External,
+  // Columns like the Columns layout in read-only memory owned by someone
+  // else, in the format written by RowBlock::appendColumnParts: a mapping of
+  // a SpillFile (see RowBlock::spill) or a serialized result (see
+  // ResultSerialization.h).
+  Mapped,
+};
+
+// Outcome of RowBlock::decodeColumn.
+struct ColumnDecodeStatus {
+  size_t num_nulls = 0;
+  // Values that couldn't be converted to the requested type.
+  size_t num_errors = 0;
+  // Row of the first of them.
+  std::optional<size_t> first_error_row;
+
+  bool ok() const {
+    return num_errors == 0;
+  }
+};
+
 // A RowBlock holds the raw data from part of a MySQL result set.  It
 // corresponds roughly to one set of rows (out of potentially many).
 // The size of a block can vary based on the whims of the MySQL client
@@ -226,6 +403,12 @@ std::chrono::microseconds parseTimeOnly(
 // block.  This prevents frequent allocations.  See data comments for
 // details.
 //
+// Columns that aren't stored as Text (see FieldStorage) hold native values.
+// getField<T> loads them directly when T matches and converts them with
+// folly::to otherwise.  They can't be returned as StringPiece, so Row's
+// operator[] and iteration throw on them; getField<std::string> formats
+// them like the text protocol would.
+//
 // Iterator access is provided as well, allowing for use cases like
 //
 // for (const auto& row : row_block) {
@@ -238,6 +421,54 @@ class RowBlock {
   explicit RowBlock(std::shared_ptr<RowFields> row_fields)
       : row_fields_info_(row_fields) {}
 
+  // `field_storage` has an entry per field, or is empty if all are Text.
+  // With a `pool`, the values of the Rows layout are copied into its chunks
+  // instead of a buffer growing with the block.
+  RowBlock(
+      std::shared_ptr<RowFields> row_fields,
+      std::vector<FieldStorage> field_storage,
+      RowBlockLayout layout = RowBlockLayout::Rows,
+      std::shared_ptr<RowBufferPool> pool = nullptr)
+      : RowBlock(
+            std::move(row_fields),
+            std::move(field_storage),
+            layout,
+            pool ? std::make_shared<PooledChunkChain>(std::move(pool))
+                 : std::shared_ptr<PooledChunkChain>()) {}
+
+  // Same, continuing in the chunks of `chain`, e.g. the chain of the other
+  // blocks of a result.
+  RowBlock(
+      std::shared_ptr<RowFields> row_fields,
+      std::vector<FieldStorage> field_storage,
+      RowBlockLayout layout,
+      std::shared_ptr<PooledChunkChain> chain)
+      : layout_(layout),
+        field_storage_(std::move(field_storage)),
+        row_fields_info_(row_fields) {
+    if (chain && layout_ == RowBlockLayout::Rows) {
+      pooled_buffer_ = PooledBuffer(std::move(chain));
+    }
+    DCHECK(
+        field_storage_.empty() ||
+        field_storage_.size() == row_fields_info_->numFields());
+    DCHECK(
+        layout_ != RowBlockLayout::External &&
+        layout_ != RowBlockLayout::Mapped);
+    if (layout_ == RowBlockLayout::Columns && row_fields_info_) {
+      columns_.resize(row_fields_info_->numFields());
+    }
+  }
+
+  // Creates a block of External rows, added with appendExternalRow, whose
+  // values are kept alive by `external_owner`.
+  RowBlock(
+      std::shared_ptr<RowFields> row_fields,
+      std::shared_ptr<const void> external_owner)
+      : layout_(RowBlockLayout::External),
+        external_owner_(std::move(external_owner)),
+        row_fields_info_(row_fields) {}
+
   ~RowBlock() {}
 
   // Given a row N and column M, return a T corresponding to the Nth
@@ -252,6 +483,15 @@ class RowBlock {
 
   // Is this field NULL?
   bool isNull(size_t row, size_t field_num) const {
+    if (layout_ == RowBlockLayout::Columns) {
+      return columns_[field_num].isNull(row);
+    }
+    if (layout_ == RowBlockLayout::External) {
+      return external_rows_[row][field_num] == nullptr;
+    }
+    if (layout_ == RowBlockLayout::Mapped) {
+      return mapped_columns_[field_num].isNull(row);
+    }
     return null_values_[row * row_fields_info_->numFields() + field_num];
   }
 
@@ -265,11 +505,21 @@ class RowBlock {
     return row_fields_info_->getFieldType(field_num);
   }
 
+  unsigned getFieldDecimals(size_t field_num) const {
+    return row_fields_info_->getFieldDecimals(field_num);
+  }
+
   // Ditto, but by name.
   enum_field_types getFieldType(folly::StringPiece field_name) const {
     return row_fields_info_->getFieldType(field_name);
   }
 
+  // How the values of the field are stored in this block.
+  FieldStorage getFieldStorage(size_t field_num) const {
+    return field_storage_.empty() ? FieldStorage::Text
+                                  : field_storage_[field_num];
+  }
+
   // Get the MySQL flags of the field.
   uint64_t getFieldFlags(size_t field_num) const {
     return row_fields_info_->getFieldFlags(field_num);
@@ -303,7 +553,125 @@ class RowBlock {
 
   // Is our rowblock empty?
   bool empty() const {
-    return field_offsets_.empty();
+    return numValues() == 0;
+  }
+
+  RowBlockLayout layout() const {
+    return layout_;
+  }
+
+  // Bytes allocated for the values and their offsets and null flags.  For
+  // External and Mapped blocks the values themselves aren't included.
+  size_t allocatedBytes() const;
+
+  // Moves the values of the block to `file` and switches it to the Mapped
+  // layout, keeping its rows and fields.  StringPieces previously returned
+  // by the block become invalid.  Throws std::system_error if the file
+  // can't be written, leaving the block unchanged.  Does nothing for blocks
+  // that are already spilled or have no rows.
+  void spill(SpillFile& file);
+
+  // Appends the values of the block to `parts` in the format of the Mapped
+  // layout: for every field its null bitmap, the ends of its values as
+  // uint32_t and its values, each padded to 8 bytes.  Parts point into the
+  // block if it has the Columns or Mapped layout, and into strings appended
+  // to `scratch` otherwise.  Returns the number of bytes appended.
+  size_t appendColumnParts(
+      std::vector<folly::ByteRange>& parts,
+      std::deque<std::string>& scratch) const;
+
+  // A Mapped block of `num_rows` rows over parts written by
+  // appendColumnParts, which must start `data` at an 8 byte aligned
+  // address and be kept alive by `owner`.  Only the ends of the values are
+  // read.  Throws std::out_of_range if the columns don't fit in `data`.
+  static RowBlock fromColumnParts(
+      std::shared_ptr<RowFields> row_fields,
+      std::vector<FieldStorage> field_storage,
+      size_t num_rows,
+      folly::ByteRange data,
+      std::shared_ptr<const void> owner);
+
+  // Empty when every field is stored as Text.
+  const std::vector<FieldStorage>& fieldStorage() const {
+    return field_storage_;
+  }
+
+  // Rows sampled by setDictionaryEncoding unless told otherwise.
+  static constexpr size_t kDictionarySampleRows = 256;
+
+  // Stores each value of low cardinality string fields once, in a dictionary
+  // per field.  The first `sample_rows` rows are stored as usual while their
+  // distinct values are counted; if there are at most `max_distinct` of
+  // them, later rows only keep a code into the dictionary, until a value
+  // beyond `max_distinct` arrives and the rest of the field is stored as
+  // usual again.  getField is unaffected, getFieldCode gives the codes.
+  // Only Text fields of string types are encoded, and only in empty blocks
+  // of the Rows or Columns layout; spilling a block stores its values in
+  // full again.
+  void setDictionaryEncoding(
+      size_t max_distinct,
+      size_t sample_rows = kDictionarySampleRows);
+
+  // Whether the values of a field have codes, i.e. the field is dictionary
+  // encoded or still being sampled without too many distinct values.  Rows
+  // appended after the dictionary filled up have no codes.
+  bool isDictionaryEncoded(size_t field_num) const {
+    return !dictionaries_.empty() &&
+        dictionaries_[field_num].state != DictionaryState::Off;
+  }
+
+  // Code of a value of a dictionary encoded field, nullopt for NULL values,
+  // fields that aren't encoded and rows past the coded ones.  Codes are
+  // numbered from 0 in the order values first appear in the block, and two
+  // coded values of the field are equal if and only if their codes are, so
+  // rows can be grouped by code.
+  std::optional<uint32_t> getFieldCode(size_t row, size_t field_num) const {
+    if (!isDictionaryEncoded(field_num)) {
+      return std::nullopt;
+    }
+    const auto& codes = dictionaries_[field_num].codes;
+    if (row >= codes.size()) {
+      return std::nullopt;
+    }
+    auto code = codes[row];
+    return code != kNullCode ? std::optional<uint32_t>(code) : std::nullopt;
+  }
+
+  // The values of a dictionary encoded field by code, empty if the field
+  // isn't encoded.
+  folly::Range<const folly::StringPiece*> dictionaryValues(
+      size_t field_num) const {
+    if (!isDictionaryEncoded(field_num)) {
+      return {};
+    }
+    return folly::range(dictionaries_[field_num].values);
+  }
+
+  // The values of a field back to back, value N ending at ends[N].
+  struct ColumnBuffer {
+    folly::StringPiece values;
+    folly::Range<const uint32_t*> ends;
+  };
+
+  // Only blocks of the Columns and Mapped layouts keep the values of a
+  // field together, nullopt for the others and for fields whose values are
+  // in a dictionary.
+  std::optional<ColumnBuffer> columnBuffer(size_t field_num) const {
+    auto num_rows = numRows();
+    if (layout_ == RowBlockLayout::Columns && !hasCodedValues(field_num)) {
+      const auto& column = columns_[field_num];
+      return ColumnBuffer{
+          folly::StringPiece(column.buffer.data(), column.buffer.size()),
+          folly::Range<const uint32_t*>(column.ends.data(), num_rows)};
+    }
+    if (layout_ == RowBlockLayout::Mapped) {
+      const auto& column = mapped_columns_[field_num];
+      return ColumnBuffer{
+          folly::StringPiece(
+              column.buffer, num_rows > 0 ? column.ends[num_rows - 1] : 0),
+          folly::Range<const uint32_t*>(column.ends, num_rows)};
+    }
+    return std::nullopt;
   }
 
   // How many fields and rows do we have?
@@ -313,8 +681,8 @@ class RowBlock {
 
   // How many rows are in this RowBlock?
   size_t numRows() const {
-    CHECK_EQ(0, field_offsets_.size() % row_fields_info_->numFields());
-    return field_offsets_.size() / row_fields_info_->numFields();
+    CHECK_EQ(0, numValues() % row_fields_info_->numFields());
+    return numValues() / row_fields_info_->numFields();
   }
 
   // Iterator support.  Allows iteration over the rows in this block.
@@ -356,30 +724,197 @@ class RowBlock {
     return Iterator(this, numRows());
   }
 
+  // Decodes every value of a field into `values`, which must have numRows()
+  // entries, converting like getField<T>.  Integers and doubles written in
+  // plain decimal are parsed without going through folly::to.  If
+  // `null_mask` isn't empty it needs a bit per row, set for NULL values.
+  // NULLs and values that can't be converted are left as T() and counted in
+  // the returned status instead of throwing.  T may be any integer type
+  // except bool, float or double.
+  template <typename T>
+  ColumnDecodeStatus decodeColumn(
+      size_t field_num,
+      folly::Range<T*> values,
+      folly::Range<uint64_t*> null_mask = {}) const;
+
   // Functions called when building a RowBlock.  Not for general use.
   void startRow() {
-    CHECK_EQ(0, field_offsets_.size() % row_fields_info_->numFields());
+    CHECK_EQ(0, numValues() % row_fields_info_->numFields());
   }
   void finishRow() {
-    CHECK_EQ(0, field_offsets_.size() % row_fields_info_->numFields());
+    CHECK_EQ(0, numValues() % row_fields_info_->numFields());
   }
   void appendValue(const folly::StringPiece value) {
-    field_offsets_.push_back(buffer_.size());
-    null_values_.push_back(false);
-    buffer_.insert(buffer_.end(), value.begin(), value.end());
+    appendBytes(value.data(), value.size(), false);
   }
   void appendNull() {
-    field_offsets_.push_back(buffer_.size());
-    null_values_.push_back(true);
+    appendBytes(nullptr, 0, true);
   }
+  // For fields not stored as Text: int64_t, uint64_t, double or MYSQL_TIME
+  // matching the field's storage.
+  template <typename T>
+  void appendNativeValue(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    DCHECK(getFieldStorage(numValues() % numFields()) != FieldStorage::Text);
+    appendBytes(reinterpret_cast<const char*>(&value), sizeof(T), false);
+  }
+  // For External blocks only, instead of the functions above.  The values of
+  // `row` must be kept alive by the block's external owner.
+  void appendExternalRow(const EphemeralRow& row);
 
   // Let the compiler make our move operations.  We disallow copies below.
   RowBlock(RowBlock&&) = default;
   RowBlock& operator=(RowBlock&&) = default;
 
  private:
+  friend class JsonRowWriter;
+
   time_t getDateField(size_t row, size_t field_num) const;
 
+  // A column of the Columns layout.  Value N of the column spans
+  // [ends[N - 1], ends[N]) of buffer, and is NULL if bit N of nulls is set.
+  struct Column {
+    std::vector<char> buffer;
+    std::vector<uint32_t> ends;
+    std::vector<uint64_t> nulls;
+
+    void append(const char* data, size_t size, bool null) {
+      auto n = ends.size();
+      if (n % 64 == 0) {
+        nulls.push_back(0);
+      }
+      if (null) {
+        nulls[n / 64] |= uint64_t(1) << (n % 64);
+      }
+      buffer.insert(buffer.end(), data, data + size);
+      CHECK_LE(buffer.size(), std::numeric_limits<uint32_t>::max());
+      ends.push_back(static_cast<uint32_t>(buffer.size()));
+    }
+    bool isNull(size_t n) const {
+      return (nulls[n / 64] >> (n % 64)) & 1;
+    }
+    size_t begin(size_t n) const {
+      return n == 0 ? 0 : ends[n - 1];
+    }
+  };
+
+  // A column of the Mapped layout, laid out like Column in memory owned by
+  // external_owner_.
+  struct MappedColumn {
+    const char* buffer;
+    const uint32_t* ends;
+    const uint64_t* nulls;
+
+    bool isNull(size_t n) const {
+      return (nulls[n / 64] >> (n % 64)) & 1;
+    }
+    size_t begin(size_t n) const {
+      return n == 0 ? 0 : ends[n - 1];
+    }
+  };
+
+  size_t numValues() const {
+    switch (layout_) {
+      case RowBlockLayout::Columns:
+      case RowBlockLayout::Mapped:
+        return num_column_values_;
+      case RowBlockLayout::External:
+        return external_lengths_.size();
+      case RowBlockLayout::Rows:
+        break;
+    }
+    return pooled_buffer_.hasPool() ? pooled_values_.size()
+                                    : field_offsets_.size();
+  }
+
+  void appendBytes(const char* data, size_t size, bool null) {
+    if (!dictionaries_.empty() && encodeValue(data, size, null)) {
+      // Only the dictionary keeps the value.
+      size = 0;
+    }
+    if (layout_ == RowBlockLayout::Columns) {
+      columns_[num_column_values_++ % numFields()].append(data, size, null);
+      return;
+    }
+    DCHECK(layout_ == RowBlockLayout::Rows);
+    null_values_.push_back(null);
+    if (pooled_buffer_.hasPool()) {
+      pooled_values_.emplace_back(pooled_buffer_.append(data, size), size);
+      return;
+    }
+    field_offsets_.push_back(buffer_.size());
+    buffer_.insert(buffer_.end(), data, data + size);
+  }
+
+  // Start of a value that isn't NULL.
+  const char* fieldData(size_t row, size_t field_num) const {
+    if (layout_ == RowBlockLayout::Columns) {
+      const auto& column = columns_[field_num];
+      return column.buffer.data() + column.begin(row);
+    }
+    if (layout_ == RowBlockLayout::External) {
+      return external_rows_[row][field_num];
+    }
+    if (layout_ == RowBlockLayout::Mapped) {
+      const auto& column = mapped_columns_[field_num];
+      return column.buffer + column.begin(row);
+    }
+    auto entry = row * numFields() + field_num;
+    if (pooled_buffer_.hasPool()) {
+      return pooled_values_[entry].data();
+    }
+    return buffer_.data() + field_offsets_[entry];
+  }
+
+  // Bytes of a value that isn't NULL, whatever its storage.
+  folly::StringPiece rawValue(size_t row, size_t field_num) const;
+
+  enum class DictionaryState : uint8_t {
+    // Every value is stored as usual and coded.
+    Sampling,
+    // Values from `first_coded_row` on are only coded.
+    Coded,
+    // Values from `first_coded_row` to `end_coded_row` are only coded, later
+    // ones didn't fit in the dictionary and are stored as usual.
+    Capped,
+    // Not encoded.
+    Off,
+  };
+
+  static constexpr uint32_t kNullCode = std::numeric_limits<uint32_t>::max();
+
+  // A field's dictionary.  `values` point into the keys of `index`, which a
+  // node map doesn't move.
+  struct Dictionary {
+    DictionaryState state = DictionaryState::Off;
+    size_t first_coded_row = 0;
+    size_t end_coded_row = std::numeric_limits<size_t>::max();
+    folly::F14NodeMap<std::string, uint32_t> index;
+    std::vector<folly::StringPiece> values;
+    size_t value_bytes = 0;
+    // A code per row, kNullCode for NULLs.
+    std::vector<uint32_t> codes;
+  };
+
+  // Codes the value appended to its field's dictionary, if any.  Returns
+  // true if the value should only be kept there.
+  bool encodeValue(const char* data, size_t size, bool null);
+
+  bool hasCodedValues(size_t field_num) const {
+    return !dictionaries_.empty() &&
+        (dictionaries_[field_num].state == DictionaryState::Coded ||
+         dictionaries_[field_num].state == DictionaryState::Capped);
+  }
+
+  // Loads a value added by appendNativeValue.  Values aren't aligned in
+  // the buffers, memcpy still compiles down to a plain load.
+  template <typename T>
+  T getNativeField(size_t row, size_t field_num) const {
+    T value;
+    std::memcpy(&value, fieldData(row, field_num), sizeof(T));
+    return value;
+  }
+
   bool isDate(size_t /*row*/, size_t field_num) const {
     switch (getFieldType(field_num)) {
       case MYSQL_TYPE_TIMESTAMP:
@@ -396,11 +931,35 @@ class RowBlock {
   // field_offsets_[N * num_fields + M] and extends to
   // field_offsets_[N * num_fields + M + 1] (or the end of the
   // buffer for the last row/column).
+  //
+  // Blocks of the Rows layout with a pool keep their values in
+  // pooled_buffer_ and their location in pooled_values_ instead of buffer_
+  // and field_offsets_.  With the Columns layout only columns_ is used
+  // instead, and with the External layout only the external_ members.
+  // Mapped blocks point mapped_columns_ into memory held by external_owner_,
+  // and count their values in num_column_values_.
+  //
+  // With dictionary encoding, dictionaries_ has an entry per field and coded
+  // values are stored as empty values in the layout's members.
+  RowBlockLayout layout_ = RowBlockLayout::Rows;
   std::vector<char> buffer_;
   std::vector<bool> null_values_;
   std::vector<size_t> field_offsets_;
-
-  // field_name_map_ and field_names_ are owned by the RowFields shared between
+  PooledBuffer pooled_buffer_;
+  std::vector<folly::StringPiece> pooled_values_;
+  std::vector<Column> columns_;
+  std::vector<MappedColumn> mapped_columns_;
+  size_t num_column_values_ = 0;
+  std::vector<MYSQL_ROW> external_rows_;
+  std::vector<uint32_t> external_lengths_;
+  std::shared_ptr<const void> external_owner_;
+  // Empty when every field is stored as Text.
+  std::vector<FieldStorage> field_storage_;
+  std::vector<Dictionary> dictionaries_;
+  size_t dictionary_max_distinct_ = 0;
+  size_t dictionary_sample_rows_ = 0;
+
+  // Field names and their index are owned by the RowFields shared between
   // RowBlocks of same query
   std::shared_ptr<RowFields> row_fields_info_;
 
@@ -417,15 +976,15 @@ class EphemeralRowFields {
     return num_fields_;
   }
 
+  // If several fields have the name, the first one is returned.  The index
+  // is built on the first lookup, since streamed rows are mostly accessed by
+  // position.
   std::optional<size_t> fieldIndexOpt(folly::StringPiece field_name) const {
-    for (int i = 0; i < num_fields_; i++) {
-      auto nameSp = folly::StringPiece(fields_[i].name, fields_[i].name_length);
-      if (nameSp == field_name) {
-        return i;
-      }
+    auto name_of = [this](size_t i) { return fieldName(i); };
+    if (!field_name_index_) {
+      field_name_index_.emplace(num_fields_, name_of, /*prefer_last=*/false);
     }
-
-    return std::nullopt;
+    return field_name_index_->find(field_name, name_of);
   }
 
   size_t fieldIndex(folly::StringPiece field_name) const {
@@ -446,7 +1005,29 @@ class EphemeralRowFields {
     return folly::StringPiece(fields_[index].name, fields_[index].name_length);
   }
 
-  std::shared_ptr<RowFields> makeBufferedFields() const;
+  folly::StringPiece tableName(size_t index) const {
+    CHECK_LT(index, num_fields_);
+    return folly::StringPiece(
+        fields_[index].table, fields_[index].table_length);
+  }
+
+  uint64_t fieldFlags(size_t index) const {
+    CHECK_LT(index, num_fields_);
+    return fields_[index].flags;
+  }
+
+  unsigned fieldDecimals(size_t index) const {
+    CHECK_LT(index, num_fields_);
+    return fields_[index].decimals;
+  }
+
+  // With `columns`, only those fields in that order.
+  std::shared_ptr<RowFields> makeBufferedFields(
+      const std::vector<size_t>* columns = nullptr) const;
+
+  // A copy owning the names and types of the fields, for rows that outlive
+  // the result, e.g. rows read ahead into a StreamedRowBatch.
+  std::shared_ptr<EphemeralRowFields> copy() const;
 
   EphemeralRowFields(EphemeralRowFields const&) = delete;
   EphemeralRowFields& operator=(EphemeralRowFields const&) = delete;
@@ -457,6 +1038,9 @@ class EphemeralRowFields {
  private:
   MYSQL_FIELD* fields_;
   int num_fields_;
+  mutable std::optional<FieldNameIndex> field_name_index_;
+  // What `fields_` points into, for copies.
+  std::shared_ptr<const void> storage_;
 };
 
 class EphemeralRow {
@@ -488,16 +1072,87 @@ class EphemeralRow {
   EphemeralRow() = default;
 
  private:
+  friend class RowBlock;
+  friend class FetchOperation;
+
   MYSQL_ROW mysql_row_ = nullptr;
   unsigned long* field_lengths_ = nullptr;
 
   EphemeralRowFields* row_fields_ = nullptr;
 };
 
+// Owning buffer of rows copied out of a RowStream, used to hand rows over
+// between threads in batches instead of one at a time. Rows are handed out
+// as EphemeralRows pointing into this buffer and are valid until `clear` is
+// called. Like libmysqlclient, values are NUL terminated and NULL values are
+// represented by a null pointer.
+class StreamedRowBatch {
+ public:
+  // Copies the row data, `row` may be invalidated right after. Rows are
+  // handed out by `consumeRow` with `row_fields`, a copy (see
+  // EphemeralRowFields::copy) shared by all rows of a query so it stays
+  // valid after the RowStream is gone. Without fields, or with `columns` to
+  // only keep those values in that order, rows can only be read through
+  // `appendTo`.
+  void append(
+      const EphemeralRow& row,
+      std::shared_ptr<EphemeralRowFields> row_fields,
+      const std::vector<size_t>* columns = nullptr);
+
+  // Returns the next unread row. Must not be called when `empty()`.
+  EphemeralRow consumeRow();
+
+  // Appends all rows to `block`, which must have as many fields. Unlike
+  // `consumeRow` it doesn't use the row fields, so it can run on another
+  // thread after the query is done.
+  void appendTo(RowBlock* block) const;
+
+  // True when all appended rows have been consumed.
+  bool empty() const {
+    return next_row_ == num_rows_;
+  }
+
+  size_t numRows() const {
+    return num_rows_;
+  }
+
+  size_t numBytes() const {
+    return data_.size();
+  }
+
+  // Bytes of the values alone, what RowBlock byte targets and caps count.
+  size_t valueBytes() const {
+    return value_bytes_;
+  }
+
+  // Fields of the rows in this batch, valid until `clear`.
+  EphemeralRowFields* getRowFields() const {
+    return row_fields_.get();
+  }
+
+  void clear();
+
+ private:
+  static constexpr size_t kNullOffset = std::numeric_limits<size_t>::max();
+
+  std::vector<char> data_;
+  std::vector<size_t> offsets_;
+  std::vector<unsigned long> lengths_;
+  // Built on the first `consumeRow`, once `data_` won't be reallocated.
+  std::vector<char*> values_;
+  size_t num_rows_ = 0;
+  size_t next_row_ = 0;
+  size_t value_bytes_ = 0;
+  std::shared_ptr<EphemeralRowFields> row_fields_;
+};
+
 // Declarations of specializations and trivial implementations.
 template <>
 folly::StringPiece RowBlock::getField(size_t row, size_t field_num) const;
 
+template <>
+std::string RowBlock::getField(size_t row, size_t field_num) const;
+
 template <>
 time_t RowBlock::getField(size_t row, size_t field_num) const;
 
@@ -512,6 +1167,21 @@ std::chrono::microseconds RowBlock::getField(size_t row, size_t field_num)
 
 template <typename T>
 T RowBlock::getField(size_t row, size_t field_num) const {
+  if constexpr (std::is_arithmetic_v<T>) {
+    if (!isNull(row, field_num)) {
+      switch (getFieldStorage(field_num)) {
+        case FieldStorage::Int64:
+          return folly::to<T>(getNativeField<int64_t>(row, field_num));
+        case FieldStorage::UInt64:
+          return folly::to<T>(getNativeField<uint64_t>(row, field_num));
+        case FieldStorage::Double:
+          return folly::to<T>(getNativeField<double>(row, field_num));
+        case FieldStorage::Text:
+        case FieldStorage::DateTime:
+          break;
+      }
+    }
+  }
   return folly::to<T>(getField<folly::StringPiece>(row, field_num));
 }
 
@@ -0,0 +1,501 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/container/F14Map.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <vector>
+#include "squangle/mysql_client/ColumnarExport.h"
+#include "squangle/mysql_client/ResultSerialization.h"
+#include "squangle/mysql_client/Row.h"
+#include "squangle/mysql_client/RowMapping.h"
+
+using namespace facebook::common::mysql_client;
+
+using folly::runBenchmarks;
+
+constexpr size_t kNumRows = 10000;
+
+// Rows of small ints, e.g. ids and flags, and rows mixing ints and short
+// strings. Every fourth value of the last int column is NULL.
+std::shared_ptr<RowFields> intFields;
+std::shared_ptr<RowFields> mixedFields;
+std::vector<std::vector<std::string>> intRows;
+std::vector<std::vector<std::string>> mixedRows;
+// Shared by the blocks built with the pooled variants, like a client's pool.
+std::shared_ptr<RowBufferPool> pool;
+
+std::shared_ptr<RowFields> makeFields(
+    const std::vector<enum_field_types>& types) {
+  std::vector<std::string> field_names;
+  std::vector<std::string> table_names;
+  for (size_t i = 0; i < types.size(); ++i) {
+    field_names.push_back(folly::to<std::string>("col", i));
+    table_names.push_back("table");
+  }
+  return std::make_shared<RowFields>(
+      std::move(field_names),
+      std::move(table_names),
+      std::vector<uint64_t>(types.size(), 0),
+      std::vector<enum_field_types>(types));
+}
+
+RowBlock makeBlock(
+    const std::shared_ptr<RowFields>& fields,
+    const std::vector<std::vector<std::string>>& rows,
+    RowBlockLayout layout,
+    std::shared_ptr<RowBufferPool> block_pool = nullptr,
+    size_t dictionary_max_distinct = 0,
+    size_t dictionary_sample_rows = RowBlock::kDictionarySampleRows) {
+  RowBlock block(fields, {}, layout, std::move(block_pool));
+  if (dictionary_max_distinct > 0) {
+    block.setDictionaryEncoding(
+        dictionary_max_distinct, dictionary_sample_rows);
+  }
+  for (const auto& row : rows) {
+    block.startRow();
+    for (size_t i = 0; i < row.size(); ++i) {
+      if (i == row.size() - 1 && row[i].empty()) {
+        block.appendNull();
+      } else {
+        block.appendValue(row[i]);
+      }
+    }
+    block.finishRow();
+  }
+  return block;
+}
+
+void build(
+    int iters,
+    const std::shared_ptr<RowFields>& fields,
+    const std::vector<std::vector<std::string>>& rows,
+    RowBlockLayout layout) {
+  for (int i = 0; i < iters; ++i) {
+    auto block = makeBlock(fields, rows, layout);
+    folly::doNotOptimizeAway(block);
+  }
+}
+
+// Blocks are destroyed every iteration, so after the first one all chunks
+// come from the pool.
+void buildPooled(
+    int iters,
+    const std::shared_ptr<RowFields>& fields,
+    const std::vector<std::vector<std::string>>& rows) {
+  for (int i = 0; i < iters; ++i) {
+    auto block = makeBlock(fields, rows, RowBlockLayout::Rows, pool);
+    folly::doNotOptimizeAway(block);
+  }
+}
+
+// Sums one column, the access pattern of a column scan.
+void scanColumn(int iters, RowBlockLayout layout) {
+  folly::BenchmarkSuspender suspender;
+  auto block = makeBlock(intFields, intRows, layout);
+  suspender.dismiss();
+  for (int i = 0; i < iters; ++i) {
+    int64_t sum = 0;
+    for (size_t row = 0; row < block.numRows(); ++row) {
+      sum += block.getField<folly::StringPiece>(row, 1).size();
+    }
+    folly::doNotOptimizeAway(sum);
+  }
+}
+
+void iterateRows(int iters, RowBlockLayout layout) {
+  folly::BenchmarkSuspender suspender;
+  auto block = makeBlock(mixedFields, mixedRows, layout);
+  suspender.dismiss();
+  for (int i = 0; i < iters; ++i) {
+    size_t total = 0;
+    for (const auto& row : block) {
+      for (size_t col = 0; col < row.size(); ++col) {
+        total += row.isNull(col) ? 0 : row[col].size();
+      }
+    }
+    folly::doNotOptimizeAway(total);
+  }
+}
+
+// Converts one int column, row by row and with decodeColumn.
+void getIntColumn(int iters, RowBlockLayout layout) {
+  folly::BenchmarkSuspender suspender;
+  auto block = makeBlock(intFields, intRows, layout);
+  suspender.dismiss();
+  for (int i = 0; i < iters; ++i) {
+    int64_t sum = 0;
+    for (size_t row = 0; row < block.numRows(); ++row) {
+      sum += block.getField<int64_t>(row, 0);
+    }
+    folly::doNotOptimizeAway(sum);
+  }
+}
+
+void decodeIntColumn(int iters, RowBlockLayout layout) {
+  folly::BenchmarkSuspender suspender;
+  auto block = makeBlock(intFields, intRows, layout);
+  std::vector<int64_t> values(block.numRows());
+  suspender.dismiss();
+  for (int i = 0; i < iters; ++i) {
+    auto status = block.decodeColumn<int64_t>(0, folly::range(values));
+    CHECK(status.ok());
+    folly::doNotOptimizeAway(values);
+  }
+}
+
+// Converts rows of intFields to structs, by name and with a RowMapping.
+struct IntRow {
+  int64_t col0;
+  int32_t col1;
+  int8_t col2;
+  std::optional<int32_t> col3;
+};
+
+constexpr auto kIntRowMapping = makeRowMapping(
+    SQUANGLE_MAP_COLUMN(IntRow, col0),
+    SQUANGLE_MAP_COLUMN(IntRow, col1),
+    SQUANGLE_MAP_COLUMN(IntRow, col2),
+    SQUANGLE_MAP_COLUMN(IntRow, col3));
+
+void getByName(int iters, RowBlockLayout layout) {
+  folly::BenchmarkSuspender suspender;
+  auto block = makeBlock(intFields, intRows, layout);
+  suspender.dismiss();
+  for (int i = 0; i < iters; ++i) {
+    std::vector<IntRow> structs;
+    for (const auto& row : block) {
+      structs.push_back(
+          {row.get<int64_t>("col0"),
+           row.get<int32_t>("col1"),
+           row.get<int8_t>("col2"),
+           row.getOptional<int32_t>("col3")});
+    }
+    folly::doNotOptimizeAway(structs);
+  }
+}
+
+void mapRows(int iters, RowBlockLayout layout) {
+  folly::BenchmarkSuspender suspender;
+  auto block = makeBlock(intFields, intRows, layout);
+  suspender.dismiss();
+  for (int i = 0; i < iters; ++i) {
+    std::vector<IntRow> structs;
+    auto indexes = kIntRowMapping.resolve(*block.getRowFields());
+    kIntRowMapping.appendRows(block, indexes, structs);
+    folly::doNotOptimizeAway(structs);
+  }
+}
+
+QueryResult makeResult(
+    const std::shared_ptr<RowFields>& fields,
+    const std::vector<std::vector<std::string>>& rows,
+    RowBlockLayout layout) {
+  QueryResult result(0);
+  result.setRowFields(fields);
+  result.appendRowBlock(makeBlock(fields, rows, layout));
+  return result;
+}
+
+std::shared_ptr<const std::string> serialize(const QueryResult& result) {
+  return std::make_shared<const std::string>(serializeQueryResult(result));
+}
+
+QueryResult deserialize(const std::shared_ptr<const std::string>& data) {
+  return deserializeQueryResult(
+      folly::ByteRange(folly::StringPiece(*data)), data);
+}
+
+// Encodes a result for a cache, as rows of dynamics and in binary.
+void encodeDynamic(int iters, RowBlockLayout layout) {
+  folly::BenchmarkSuspender suspender;
+  auto result = makeResult(mixedFields, mixedRows, layout);
+  suspender.dismiss();
+  for (int i = 0; i < iters; ++i) {
+    folly::dynamic rows = folly::dynamic::array;
+    for (const auto& row : result) {
+      folly::dynamic values = folly::dynamic::array;
+      for (size_t col = 0; col < row.size(); ++col) {
+        values.push_back(row.getDynamic(col));
+      }
+      rows.push_back(std::move(values));
+    }
+    folly::doNotOptimizeAway(rows);
+  }
+}
+
+void encodeBinary(int iters, RowBlockLayout layout) {
+  folly::BenchmarkSuspender suspender;
+  auto result = makeResult(mixedFields, mixedRows, layout);
+  suspender.dismiss();
+  for (int i = 0; i < iters; ++i) {
+    auto data = serialize(result);
+    folly::doNotOptimizeAway(data);
+  }
+}
+
+// Hands a result to a columnar engine, transposed by hand and as Arrow
+// batches.
+void transposeRows(int iters, RowBlockLayout layout) {
+  folly::BenchmarkSuspender suspender;
+  auto result = makeResult(mixedFields, mixedRows, layout);
+  suspender.dismiss();
+  for (int i = 0; i < iters; ++i) {
+    std::vector<int64_t> ids;
+    std::vector<std::string> names;
+    std::vector<std::string> paddings;
+    std::vector<std::optional<int32_t>> values;
+    for (const auto& row : result) {
+      ids.push_back(row.get<int64_t>(0));
+      names.push_back(row.get<std::string>(1));
+      paddings.push_back(row.get<std::string>(2));
+      values.push_back(row.getOptional<int32_t>(3));
+    }
+    folly::doNotOptimizeAway(values);
+  }
+}
+
+void toColumnar(int iters, RowBlockLayout layout) {
+  folly::BenchmarkSuspender suspender;
+  auto result = makeResult(mixedFields, mixedRows, layout);
+  suspender.dismiss();
+  for (int i = 0; i < iters; ++i) {
+    auto batches = result.toColumnar();
+    folly::doNotOptimizeAway(batches);
+  }
+}
+
+BENCHMARK_NAMED_PARAM(
+    build,
+    ints_rows,
+    intFields,
+    intRows,
+    RowBlockLayout::Rows);
+BENCHMARK_RELATIVE_NAMED_PARAM(
+    build,
+    ints_columns,
+    intFields,
+    intRows,
+    RowBlockLayout::Columns);
+BENCHMARK_RELATIVE_NAMED_PARAM(buildPooled, ints_pooled, intFields, intRows);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(
+    build,
+    mixed_rows,
+    mixedFields,
+    mixedRows,
+    RowBlockLayout::Rows);
+BENCHMARK_RELATIVE_NAMED_PARAM(
+    build,
+    mixed_columns,
+    mixedFields,
+    mixedRows,
+    RowBlockLayout::Columns);
+BENCHMARK_RELATIVE_NAMED_PARAM(
+    buildPooled,
+    mixed_pooled,
+    mixedFields,
+    mixedRows);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(scanColumn, rows, RowBlockLayout::Rows);
+BENCHMARK_RELATIVE_NAMED_PARAM(scanColumn, columns, RowBlockLayout::Columns);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(iterateRows, rows, RowBlockLayout::Rows);
+BENCHMARK_RELATIVE_NAMED_PARAM(iterateRows, columns, RowBlockLayout::Columns);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(getIntColumn, rows, RowBlockLayout::Rows);
+BENCHMARK_RELATIVE_NAMED_PARAM(decodeIntColumn, rows, RowBlockLayout::Rows);
+BENCHMARK_RELATIVE_NAMED_PARAM(
+    decodeIntColumn,
+    columns,
+    RowBlockLayout::Columns);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(getByName, rows, RowBlockLayout::Rows);
+BENCHMARK_RELATIVE_NAMED_PARAM(mapRows, rows, RowBlockLayout::Rows);
+BENCHMARK_RELATIVE_NAMED_PARAM(mapRows, columns, RowBlockLayout::Columns);
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(encodeDynamic, rows, RowBlockLayout::Rows);
+BENCHMARK_RELATIVE_NAMED_PARAM(encodeBinary, rows, RowBlockLayout::Rows);
+BENCHMARK_RELATIVE_NAMED_PARAM(encodeBinary, columns, RowBlockLayout::Columns);
+BENCHMARK(decodeBinary, iters) {
+  folly::BenchmarkSuspender suspender;
+  auto data =
+      serialize(makeResult(mixedFields, mixedRows, RowBlockLayout::Columns));
+  suspender.dismiss();
+  for (unsigned i = 0; i < iters; ++i) {
+    auto result = deserialize(data);
+    folly::doNotOptimizeAway(result);
+  }
+}
+BENCHMARK_DRAW_LINE();
+
+// Counts the rows per value of the low cardinality string column, by value
+// and by dictionary code.
+BENCHMARK(countByValue, iters) {
+  folly::BenchmarkSuspender suspender;
+  auto block = makeBlock(mixedFields, mixedRows, RowBlockLayout::Rows);
+  suspender.dismiss();
+  for (unsigned i = 0; i < iters; ++i) {
+    folly::F14FastMap<folly::StringPiece, size_t> counts;
+    for (size_t row = 0; row < block.numRows(); ++row) {
+      ++counts[block.getField<folly::StringPiece>(row, 2)];
+    }
+    folly::doNotOptimizeAway(counts);
+  }
+}
+BENCHMARK_RELATIVE(countByCode, iters) {
+  folly::BenchmarkSuspender suspender;
+  auto block =
+      makeBlock(mixedFields, mixedRows, RowBlockLayout::Rows, nullptr, 64);
+  CHECK(block.isDictionaryEncoded(2));
+  suspender.dismiss();
+  for (unsigned i = 0; i < iters; ++i) {
+    std::vector<size_t> counts(block.dictionaryValues(2).size());
+    for (size_t row = 0; row < block.numRows(); ++row) {
+      ++counts[*block.getFieldCode(row, 2)];
+    }
+    folly::doNotOptimizeAway(counts);
+  }
+}
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(transposeRows, rows, RowBlockLayout::Rows);
+BENCHMARK_RELATIVE_NAMED_PARAM(toColumnar, rows, RowBlockLayout::Rows);
+BENCHMARK_RELATIVE_NAMED_PARAM(toColumnar, columns, RowBlockLayout::Columns);
+BENCHMARK_DRAW_LINE();
+
+// Checks the Arrow batches of both layouts hold the same offsets and values.
+void compareColumnar(const RowBlock& row_block, const RowBlock& column_block) {
+  auto expected = toColumnarBatch(row_block);
+  auto actual = toColumnarBatch(column_block);
+  CHECK_EQ(expected.columns.size(), actual.columns.size());
+  for (size_t col = 0; col < expected.columns.size(); ++col) {
+    const auto& a = expected.columns[col];
+    const auto& b = actual.columns[col];
+    CHECK_EQ(a.format, b.format);
+    CHECK_EQ(a.null_count, b.null_count);
+    CHECK_EQ(a.buffers.size(), b.buffers.size());
+    if (a.format != "u") {
+      continue;
+    }
+    const auto* a_offsets = static_cast<const int32_t*>(a.buffers[1]);
+    const auto* b_offsets = static_cast<const int32_t*>(b.buffers[1]);
+    auto size = a_offsets[a.length];
+    CHECK(std::equal(a_offsets, a_offsets + a.length + 1, b_offsets));
+    CHECK_EQ(
+        folly::StringPiece(static_cast<const char*>(a.buffers[2]), size),
+        folly::StringPiece(static_cast<const char*>(b.buffers[2]), size));
+  }
+}
+
+// Checks both layouts, pooled rows, spilled rows, serialized rows and
+// dictionary encoded rows return the same values and prints their footprint.
+void compareLayouts(
+    const char* name,
+    const std::shared_ptr<RowFields>& fields,
+    const std::vector<std::vector<std::string>>& rows) {
+  auto row_block = makeBlock(fields, rows, RowBlockLayout::Rows);
+  auto column_block = makeBlock(fields, rows, RowBlockLayout::Columns);
+  auto pooled_block = makeBlock(fields, rows, RowBlockLayout::Rows, pool);
+  auto spilled_block = makeBlock(fields, rows, RowBlockLayout::Rows);
+  auto dictionary_block =
+      makeBlock(fields, rows, RowBlockLayout::Rows, nullptr, 64);
+  auto dictionary_column_block =
+      makeBlock(fields, rows, RowBlockLayout::Columns, nullptr, 64);
+  SpillFile spill_file;
+  spilled_block.spill(spill_file);
+  auto serialized = serialize(makeResult(fields, rows, RowBlockLayout::Rows));
+  auto deserialized = deserialize(serialized);
+  const auto& serialized_block = deserialized.rows().front();
+  for (const auto* block :
+       {&column_block,
+        &pooled_block,
+        &spilled_block,
+        &serialized_block,
+        &dictionary_block,
+        &dictionary_column_block}) {
+    CHECK_EQ(row_block.numRows(), block->numRows());
+    for (size_t row = 0; row < row_block.numRows(); ++row) {
+      for (size_t col = 0; col < row_block.numFields(); ++col) {
+        CHECK_EQ(row_block.isNull(row, col), block->isNull(row, col));
+        CHECK_EQ(
+            row_block.getField<folly::StringPiece>(row, col),
+            block->getField<folly::StringPiece>(row, col));
+      }
+    }
+  }
+  compareColumnar(row_block, column_block);
+  compareColumnar(row_block, dictionary_column_block);
+  LOG(INFO) << name << ": rows layout " << row_block.allocatedBytes()
+            << " bytes, columns layout " << column_block.allocatedBytes()
+            << " bytes, pooled rows " << pooled_block.allocatedBytes()
+            << " bytes, spilled " << spilled_block.allocatedBytes()
+            << " bytes in memory and " << spill_file.size() << " on disk, "
+            << serialized->size() << " bytes serialized, "
+            << dictionary_block.allocatedBytes() << " bytes with dictionaries";
+}
+
+// A field coded after its sample stops growing its dictionary at the cap,
+// and the rows past it keep their values.
+void checkDictionaryCap() {
+  for (auto layout : {RowBlockLayout::Rows, RowBlockLayout::Columns}) {
+    // The names of the second field are all distinct, so the 32 sampled
+    // rows fit and the dictionary fills up at row 64.
+    auto block = makeBlock(mixedFields, mixedRows, layout, nullptr, 64, 32);
+    CHECK_EQ(block.dictionaryValues(1).size(), 64);
+    CHECK(block.getFieldCode(63, 1));
+    CHECK(!block.getFieldCode(64, 1));
+    for (size_t row = 0; row < mixedRows.size(); ++row) {
+      CHECK_EQ(block.getField<folly::StringPiece>(row, 1), mixedRows[row][1]);
+    }
+  }
+}
+
+int main(int /*argc*/, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  pool = std::make_shared<RowBufferPool>();
+
+  intFields = makeFields(
+      {MYSQL_TYPE_LONGLONG, MYSQL_TYPE_LONG, MYSQL_TYPE_TINY, MYSQL_TYPE_LONG});
+  mixedFields = makeFields(
+      {MYSQL_TYPE_LONGLONG,
+       MYSQL_TYPE_VAR_STRING,
+       MYSQL_TYPE_VAR_STRING,
+       MYSQL_TYPE_LONG});
+  for (size_t i = 0; i < kNumRows; ++i) {
+    auto last = i % 4 ? folly::to<std::string>(i % 1000) : std::string();
+    intRows.push_back(
+        {folly::to<std::string>(1000000 + i),
+         folly::to<std::string>(i % 100),
+         folly::to<std::string>(i % 2),
+         last});
+    mixedRows.push_back(
+        {folly::to<std::string>(1000000 + i),
+         folly::to<std::string>("user_", i),
+         std::string(i % 32, 'x'),
+         last});
+  }
+
+  compareLayouts("ints", intFields, intRows);
+  compareLayouts("mixed", mixedFields, mixedRows);
+  checkDictionaryCap();
+  runBenchmarks();
+  auto stats = pool->stats();
+  LOG(INFO) << "Pool: " << stats.hits << " hits, " << stats.misses
+            << " misses";
+  return 0;
+}
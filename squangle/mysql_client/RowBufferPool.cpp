@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/portability/SysMman.h>
+#include <glog/logging.h>
+#include <cstring>
+#include <new>
+
+#include "squangle/mysql_client/RowBufferPool.h"
+
+namespace facebook::common::mysql_client {
+
+namespace {
+
+constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+size_t roundedChunkSize(const RowBufferPool::Options& options) {
+  if (!options.huge_pages) {
+    return options.chunk_size;
+  }
+  return (options.chunk_size + kHugePageSize - 1) / kHugePageSize *
+      kHugePageSize;
+}
+
+} // namespace
+
+RowBufferPool::RowBufferPool(Options options)
+    : chunk_size_(roundedChunkSize(options)),
+      max_free_chunks_(options.max_free_chunks),
+      huge_pages_(options.huge_pages) {
+  CHECK_GT(chunk_size_, 0);
+}
+
+RowBufferPool::~RowBufferPool() {
+  for (auto* chunk : *free_chunks_.wlock()) {
+    freeChunk(chunk);
+  }
+}
+
+char* RowBufferPool::allocate() {
+  {
+    auto free_chunks = free_chunks_.wlock();
+    if (!free_chunks->empty()) {
+      auto* chunk = free_chunks->back();
+      free_chunks->pop_back();
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return chunk;
+    }
+  }
+  misses_.fetch_add(1, std::memory_order_relaxed);
+  return allocateChunk();
+}
+
+void RowBufferPool::release(char* chunk) {
+  {
+    auto free_chunks = free_chunks_.wlock();
+    if (free_chunks->size() < max_free_chunks_) {
+      free_chunks->push_back(chunk);
+      return;
+    }
+  }
+  freeChunk(chunk);
+}
+
+RowBufferPool::Stats RowBufferPool::stats() const {
+  Stats stats;
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  stats.free_chunks = free_chunks_.rlock()->size();
+  return stats;
+}
+
+char* RowBufferPool::allocateChunk() const {
+  if (!huge_pages_) {
+    return new char[chunk_size_];
+  }
+  void* chunk = mmap(
+      nullptr,
+      chunk_size_,
+      PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS,
+      -1,
+      0);
+  if (chunk == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+#ifdef MADV_HUGEPAGE
+  // Only a hint, chunks still work with regular pages.
+  madvise(chunk, chunk_size_, MADV_HUGEPAGE);
+#endif
+  return static_cast<char*>(chunk);
+}
+
+void RowBufferPool::freeChunk(char* chunk) const {
+  if (!huge_pages_) {
+    delete[] chunk;
+    return;
+  }
+  PCHECK(munmap(chunk, chunk_size_) == 0);
+}
+
+const std::shared_ptr<PooledChunk>& PooledChunkChain::chunkFor(size_t size) {
+  DCHECK_LE(size, chunkSize());
+  if (!current_ || chunkSize() - current_->used < size) {
+    current_ = std::make_shared<PooledChunk>(pool_);
+  }
+  return current_;
+}
+
+const char* PooledBuffer::append(const char* data, size_t size) {
+  if (size == 0) {
+    return nullptr;
+  }
+  DCHECK(chain_);
+  if (size > chain_->chunkSize()) {
+    large_values_.push_back(std::make_unique<char[]>(size));
+    large_bytes_ += size;
+    std::memcpy(large_values_.back().get(), data, size);
+    return large_values_.back().get();
+  }
+  const auto& chunk = chain_->chunkFor(size);
+  if (chunks_.empty() || chunks_.back() != chunk) {
+    chunks_.push_back(chunk);
+  }
+  auto* dest = chunk->data + chunk->used;
+  std::memcpy(dest, data, size);
+  chunk->used += size;
+  chunk_bytes_ += size;
+  return dest;
+}
+
+size_t PooledBuffer::allocatedBytes() const {
+  return chunks_.capacity() * sizeof(std::shared_ptr<PooledChunk>) +
+      large_values_.capacity() * sizeof(std::unique_ptr<char[]>) +
+      large_bytes_ + chunk_bytes_;
+}
+
+} // namespace facebook::common::mysql_client
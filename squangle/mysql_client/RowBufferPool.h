@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/Synchronized.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace facebook::common::mysql_client {
+
+// Pool of fixed size chunks holding the values of RowBlocks, usually shared
+// by all operations of a client (see MysqlClientBase::setRowBufferPool).
+// The blocks of a result share chunks as rows arrive (see PooledChunkChain)
+// and hand them back when destroyed, so steady query traffic keeps reusing
+// the same memory instead of growing and freeing a buffer per result.
+//
+// Thread safe, since results are usually destroyed outside the client thread.
+class RowBufferPool {
+ public:
+  struct Options {
+    size_t chunk_size = 64 * 1024;
+    // Free chunks kept for reuse; chunks released beyond this are freed.
+    size_t max_free_chunks = 1024;
+    // Maps chunks with transparent huge pages requested. The chunk size is
+    // then rounded up to a multiple of the huge page size.
+    bool huge_pages = false;
+  };
+
+  struct Stats {
+    // Chunks served from the free list and newly allocated ones.
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    size_t free_chunks = 0;
+  };
+
+  explicit RowBufferPool(Options options);
+  RowBufferPool() : RowBufferPool(Options()) {}
+  ~RowBufferPool();
+
+  size_t chunkSize() const {
+    return chunk_size_;
+  }
+
+  // Returns a chunk of chunkSize() bytes.
+  char* allocate();
+  void release(char* chunk);
+
+  Stats stats() const;
+
+  RowBufferPool(const RowBufferPool&) = delete;
+  RowBufferPool& operator=(const RowBufferPool&) = delete;
+
+ private:
+  char* allocateChunk() const;
+  void freeChunk(char* chunk) const;
+
+  const size_t chunk_size_;
+  const size_t max_free_chunks_;
+  const bool huge_pages_;
+  folly::Synchronized<std::vector<char*>> free_chunks_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+// A chunk of a RowBufferPool, returned to the pool once the last
+// PooledBuffer holding values in it is destroyed.
+struct PooledChunk {
+  explicit PooledChunk(std::shared_ptr<RowBufferPool> chunk_pool)
+      : pool(std::move(chunk_pool)), data(pool->allocate()) {}
+  ~PooledChunk() {
+    pool->release(data);
+  }
+
+  PooledChunk(const PooledChunk&) = delete;
+  PooledChunk& operator=(const PooledChunk&) = delete;
+
+  const std::shared_ptr<RowBufferPool> pool;
+  char* const data;
+  size_t used = 0;
+};
+
+// The chunks the blocks of a result are copied into one after another, so
+// each block continues in the chunk the previous one left off in instead of
+// taking whole chunks of its own.  Not thread safe: the blocks sharing a
+// chain must be filled one at a time.
+class PooledChunkChain {
+ public:
+  explicit PooledChunkChain(std::shared_ptr<RowBufferPool> pool)
+      : pool_(std::move(pool)) {}
+
+  size_t chunkSize() const {
+    return pool_->chunkSize();
+  }
+
+  // The chunk to copy a value of `size` bytes to, at most chunkSize().
+  // Takes a new one when the current chunk doesn't have room left.
+  const std::shared_ptr<PooledChunk>& chunkFor(size_t size);
+
+ private:
+  std::shared_ptr<RowBufferPool> pool_;
+  std::shared_ptr<PooledChunk> current_;
+};
+
+// Append-only storage in the chunks of a PooledChunkChain.  Appended values
+// never move, values too large for a chunk get an allocation of their own.
+class PooledBuffer {
+ public:
+  PooledBuffer() = default;
+  explicit PooledBuffer(std::shared_ptr<PooledChunkChain> chain)
+      : chain_(std::move(chain)) {}
+
+  PooledBuffer(PooledBuffer&& other) noexcept = default;
+  PooledBuffer& operator=(PooledBuffer&& other) noexcept = default;
+
+  bool hasPool() const {
+    return chain_ != nullptr;
+  }
+
+  // Copies `size` bytes from `data` and returns where they were copied to,
+  // nullptr if `size` is 0.
+  const char* append(const char* data, size_t size);
+
+  // Counts the bytes used in shared chunks, not the whole chunks.
+  size_t allocatedBytes() const;
+
+  PooledBuffer(const PooledBuffer&) = delete;
+  PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+ private:
+  std::shared_ptr<PooledChunkChain> chain_;
+  std::vector<std::shared_ptr<PooledChunk>> chunks_;
+  std::vector<std::unique_ptr<char[]>> large_values_;
+  size_t large_bytes_ = 0;
+  size_t chunk_bytes_ = 0;
+};
+
+} // namespace facebook::common::mysql_client
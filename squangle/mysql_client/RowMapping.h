@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+//
+// Declarative mapping of result rows to C++ structs.  A mapping lists the
+// columns to read and the struct members they go to:
+//
+//   struct User {
+//     int64_t id;
+//     std::string name;
+//     std::optional<int64_t> age;
+//   };
+//
+//   constexpr auto kUserMapping = makeRowMapping(
+//       SQUANGLE_MAP_COLUMN(User, id),
+//       SQUANGLE_MAP_COLUMN(User, name),
+//       mapColumn("user_age", &User::age));
+//
+//   std::vector<User> users = kUserMapping.mapRows(query_result);
+//
+// Column names are looked up once per result rather than once per row and
+// field as with Row::get<T>("name").  Values are converted with
+// RowBlock::getField<T>, so a NULL throws unless the member is a
+// std::optional, which is then left empty.
+
+#ifndef COMMON_ASYNC_MYSQL_ROW_MAPPING_H
+#define COMMON_ASYNC_MYSQL_ROW_MAPPING_H
+
+#include <array>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <folly/Range.h>
+
+#include "squangle/mysql_client/DbResult.h"
+#include "squangle/mysql_client/Row.h"
+
+namespace facebook {
+namespace common {
+namespace mysql_client {
+
+// A column read into a member of Struct, see makeRowMapping.
+template <typename Struct, typename Member>
+struct ColumnBinding {
+  folly::StringPiece name;
+  Member Struct::*member;
+};
+
+template <typename Struct, typename Member>
+constexpr ColumnBinding<Struct, Member> mapColumn(
+    folly::StringPiece name,
+    Member Struct::*member) {
+  return ColumnBinding<Struct, Member>{name, member};
+}
+
+// Maps the column named like the member.
+#define SQUANGLE_MAP_COLUMN(Struct, member) \
+  ::facebook::common::mysql_client::mapColumn(#member, &Struct::member)
+
+template <typename Struct, typename... Members>
+class RowMapping {
+ public:
+  // The field index of each column, in the order they were given.
+  using Indexes = std::array<size_t, sizeof...(Members)>;
+
+  constexpr explicit RowMapping(ColumnBinding<Struct, Members>... columns)
+      : columns_(columns...) {}
+
+  // Throws std::out_of_range if a column is missing from `fields`.
+  Indexes resolve(const RowFields& fields) const {
+    Indexes indexes;
+    resolve(fields, indexes, std::index_sequence_for<Members...>());
+    return indexes;
+  }
+
+  // Appends a Struct per row of `block`, using indexes resolved against the
+  // block's fields.
+  void appendRows(
+      const RowBlock& block,
+      const Indexes& indexes,
+      std::vector<Struct>& out) const {
+    auto num_rows = block.numRows();
+    out.reserve(out.size() + num_rows);
+    for (size_t row = 0; row < num_rows; ++row) {
+      Struct& value = out.emplace_back();
+      assign(block, row, indexes, value, std::index_sequence_for<Members...>());
+    }
+  }
+
+  std::vector<Struct> mapRows(const QueryResult& result) const {
+    std::vector<Struct> ret;
+    if (!result.hasRows()) {
+      return ret;
+    }
+    auto indexes = resolve(*result.getRowFields());
+    ret.reserve(result.numRows());
+    for (const auto& block : result.rows()) {
+      appendRows(block, indexes, ret);
+    }
+    return ret;
+  }
+
+ private:
+  template <size_t... I>
+  void resolve(
+      const RowFields& fields,
+      Indexes& indexes,
+      std::index_sequence<I...>) const {
+    ((indexes[I] = fields.fieldIndex(std::get<I>(columns_).name)), ...);
+  }
+
+  template <size_t... I>
+  void assign(
+      const RowBlock& block,
+      size_t row,
+      const Indexes& indexes,
+      Struct& value,
+      std::index_sequence<I...>) const {
+    (assignField(
+         block, row, indexes[I], value.*(std::get<I>(columns_).member)),
+     ...);
+  }
+
+  template <typename T>
+  static void assignField(
+      const RowBlock& block,
+      size_t row,
+      size_t field_num,
+      T& member) {
+    member = block.getField<T>(row, field_num);
+  }
+
+  template <typename T>
+  static void assignField(
+      const RowBlock& block,
+      size_t row,
+      size_t field_num,
+      std::optional<T>& member) {
+    if (block.isNull(row, field_num)) {
+      member.reset();
+    } else {
+      member = block.getField<T>(row, field_num);
+    }
+  }
+
+  std::tuple<ColumnBinding<Struct, Members>...> columns_;
+};
+
+template <typename Struct, typename... Members>
+constexpr RowMapping<Struct, Members...> makeRowMapping(
+    ColumnBinding<Struct, Members>... columns) {
+  return RowMapping<Struct, Members...>(columns...);
+}
+
+} // namespace mysql_client
+} // namespace common
+} // namespace facebook
+
+#endif // COMMON_ASYNC_MYSQL_ROW_MAPPING_H
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fcntl.h>
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/portability/SysMman.h>
+#include <folly/portability/SysUio.h>
+#include <folly/portability/Unistd.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <climits>
+#include <filesystem>
+#include <vector>
+
+#include "squangle/mysql_client/SpillFile.h"
+
+namespace facebook::common::mysql_client {
+
+namespace {
+
+size_t pageSize() {
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  return page_size;
+}
+
+} // namespace
+
+SpillFile::SpillFile(const std::string& directory) {
+  auto dir = directory.empty() ? std::filesystem::temp_directory_path()
+                               : std::filesystem::path(directory);
+  auto path = (dir / "squangle_spill.XXXXXX").string();
+  std::vector<char> name(path.begin(), path.end());
+  name.push_back('\0');
+  fd_ = mkstemp(name.data());
+  folly::checkUnixError(fd_, "Failed to create spill file in ", dir.string());
+  // Only the descriptor and the mappings keep the file alive.
+  if (unlink(name.data()) != 0) {
+    PLOG(WARNING) << "Failed to unlink spill file " << name.data();
+  }
+}
+
+SpillFile::~SpillFile() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+std::shared_ptr<const char> SpillFile::append(
+    const std::vector<folly::ByteRange>& parts) {
+  std::vector<iovec> iov;
+  iov.reserve(parts.size());
+  size_t size = 0;
+  for (auto part : parts) {
+    iov.push_back(iovec{const_cast<unsigned char*>(part.data()), part.size()});
+    size += part.size();
+  }
+  CHECK_GT(size, 0);
+
+  auto offset = size_;
+  for (size_t i = 0; i < iov.size(); i += IOV_MAX) {
+    int count = std::min<size_t>(iov.size() - i, IOV_MAX);
+    size_t batch_size = 0;
+    for (int j = 0; j < count; ++j) {
+      batch_size += iov[i + j].iov_len;
+    }
+    auto written = folly::pwritevFull(fd_, &iov[i], count, offset);
+    folly::checkUnixError(written, "Failed to write spill file");
+    if (static_cast<size_t>(written) != batch_size) {
+      folly::throwSystemErrorExplicit(ENOSPC, "Short write to spill file");
+    }
+    offset += batch_size;
+  }
+  auto start = size_;
+  size_ = (start + size + pageSize() - 1) / pageSize() * pageSize();
+
+  void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, start);
+  if (mapped == MAP_FAILED) {
+    folly::throwSystemError("Failed to map spill file");
+  }
+  return std::shared_ptr<const char>(
+      static_cast<const char*>(mapped), [size](const char* p) {
+        PCHECK(munmap(const_cast<char*>(p), size) == 0);
+      });
+}
+
+} // namespace facebook::common::mysql_client
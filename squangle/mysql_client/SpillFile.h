@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/Range.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace facebook::common::mysql_client {
+
+// Unlinked temporary file that RowBlocks are spilled to (see
+// RowBlock::spill).  Every append is mapped back read-only, so spilled
+// values are paged in by the kernel when read and can be dropped from
+// memory under pressure like any file backed page.
+//
+// Mappings stay valid after the SpillFile is destroyed; the disk space is
+// reclaimed once the file and all its mappings are gone.  Not thread safe.
+class SpillFile {
+ public:
+  // Creates the file in `directory`, or the system's temp directory if
+  // empty.  Throws std::system_error on failure.
+  explicit SpillFile(const std::string& directory = "");
+  ~SpillFile();
+
+  // Writes `parts` one after the other at the next page aligned offset of
+  // the file and returns them mapped, they must not all be empty.  Throws
+  // std::system_error on failure, e.g. when the disk is full.
+  std::shared_ptr<const char> append(
+      const std::vector<folly::ByteRange>& parts);
+
+  // Bytes written to the file so far, including alignment padding.
+  size_t size() const {
+    return size_;
+  }
+
+  SpillFile(const SpillFile&) = delete;
+  SpillFile& operator=(const SpillFile&) = delete;
+
+ private:
+  int fd_ = -1;
+  size_t size_ = 0;
+};
+
+} // namespace facebook::common::mysql_client
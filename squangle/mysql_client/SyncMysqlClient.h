@@ -83,7 +83,7 @@ class SyncMysqlClient : public MysqlClientBase {
   }
 
   // Sync implementation of mysql handler interface
-  class SyncMysqlHandler : public MysqlHandler {
+  class SyncMysqlHandler final : public MysqlHandler {
     Status tryConnect(
         MYSQL* mysql,
         const ConnectionOptions& opts,
@@ -127,9 +127,19 @@ class SyncMysqlClient : public MysqlClientBase {
       row = mysql_fetch_row(res);
       return DONE;
     }
+    size_t fetchRows(
+        MYSQL_RES* res,
+        folly::Range<MYSQL_ROW*> rows,
+        unsigned long* lengths,
+        bool& finished) override {
+      return fetchReadyRows(*this, res, rows, lengths, finished);
+    }
     MYSQL_RES* getResult(MYSQL* mysql) override {
       return mysql_store_result(mysql);
     }
+    bool buffersResults() const override {
+      return true;
+    }
     Status resetConn(MYSQL* mysql) override {
       return mysql_reset_connection(mysql) ? ERROR : DONE;
     }
@@ -143,6 +153,19 @@ class SyncMysqlClient : public MysqlClientBase {
           ? ERROR
           : DONE;
     }
+    Status prepareStatement(MYSQL_STMT* stmt, folly::StringPiece statement)
+        override {
+      return mysql_stmt_prepare(stmt, statement.begin(), statement.size())
+          ? ERROR
+          : DONE;
+    }
+    Status executeStatement(MYSQL_STMT* stmt) override {
+      return mysql_stmt_execute(stmt) ? ERROR : DONE;
+    }
+    Status fetchStatementRow(MYSQL_STMT* stmt, int& fetch_result) override {
+      fetch_result = mysql_stmt_fetch(stmt);
+      return fetch_result == 1 ? ERROR : DONE;
+    }
   } mysql_handler_;
 };
 